@@ -0,0 +1,561 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A headless microbenchmark for FaderVSTAudioProcessor::processBlock.
+ *
+ * Sweeps sample precisions, block sizes, channel layouts and fader states,
+ * timing every call individually, and prints the results as JSON on the
+ * standard output so that runs of different builds can be compared.
+ *
+ * Also times how long the editor takes to open, for the first editor of the
+ * process and for the ones after it.
+ *
+ * With --metering, the input and output levels are measured in every block,
+ * as they are while the editor is open.
+ *
+ * With --osc-loopback, only the OSC remote control is tested instead: a
+ * client sends fades to the processor over the loopback interface while
+ * blocks are processed, and the time they took to reach the audio thread is
+ * reported. The exit code is non-zero if any of them was lost.
+ *
+ * With --check-block-sizes, a script of fades, gain changes and range
+ * changes is rendered in blocks of 32 and of 4096 samples instead, and the
+ * exit code is non-zero if the outputs differ in any bit.
+ *
+ * When built with the FADERVST_RT_AUDIT option, anything that processBlock
+ * does that may allocate or block is recorded (see RealtimeAudit.h), and
+ * dumped to the standard error after the run, which then fails.
+ *
+ * Usage: FaderVSTBench [--quick] [--metering] [--osc-loopback] [--check-block-sizes]
+ */
+
+#include "PluginProcessor.h"
+#include "PluginEditor.h"
+#include "RealtimeAudit.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#if JUCE_INTEL
+ #if JUCE_MSVC
+  #include <intrin.h>
+ #else
+  #include <x86intrin.h>
+ #endif
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/** The sample rate every benchmark runs at. */
+constexpr double benchSampleRate = 48000.0;
+
+/**
+ * Reads the CPU timestamp counter, or returns 0 where there is none we can
+ * read from user space.
+ */
+uint64_t readCycleCounter(){
+#if JUCE_INTEL
+    return (uint64_t) __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * The fader states that are benchmarked.
+ */
+enum class State {
+    /** Steady at a gain of exactly 1.0. */
+    Unity,
+    /** Steady at a gain other than 1.0. */
+    Steady,
+    /** Steady at a gain of exactly 0.0. */
+    Silent,
+    /** In the middle of a fade that lasts longer than the block. */
+    Fading,
+    /** A fade that ends in the middle of the block. */
+    FadeEndingMidBlock,
+};
+
+const char* getStateName(State state){
+    switch (state){
+        case State::Unity: return "unity";
+        case State::Steady: return "steady";
+        case State::Silent: return "silent";
+        case State::Fading: return "fading";
+        case State::FadeEndingMidBlock: return "fadeEndingMidBlock";
+    }
+
+    return "";
+}
+
+/**
+ * Sets a parameter of the processor to a (non normalised) value.
+ */
+void setParameter(juce::AudioProcessor &processor, const juce::String &id, float value){
+    for (auto *param : processor.getParameters()){
+        if (auto *ranged = dynamic_cast<juce::RangedAudioParameter*>(param)){
+            if (ranged->paramID == id){
+                ranged->setValueNotifyingHost(ranged->convertTo0to1(value));
+                return;
+            }
+        }
+    }
+}
+
+struct Layout {
+    const char* name;
+    juce::AudioChannelSet channels;
+};
+
+/**
+ * Runs a single block through the processor without timing it, so that
+ * queued changes to the fader state take effect.
+ */
+template <typename SampleType>
+void settle(FaderVSTAudioProcessor &processor, juce::AudioBuffer<SampleType> &buffer, juce::MidiBuffer &midi){
+    buffer.clear();
+    processor.processBlock(buffer, midi);
+}
+
+/**
+ * Brings the fader to the requested state.
+ *
+ * For State::FadeEndingMidBlock this has to be called before every timed
+ * block, since each block finishes the fade it started.
+ */
+template <typename SampleType>
+void prepareState(FaderVSTAudioProcessor &processor, State state, int blockSize,
+                  juce::AudioBuffer<SampleType> &scratch, juce::MidiBuffer &midi){
+    switch (state){
+        case State::Unity:
+            processor.setGainRange(0.0f, 1.0f);
+            processor.fadeUp(0.0);
+            settle(processor, scratch, midi);
+            break;
+
+        case State::Steady:
+            processor.setGainRange(0.0f, 0.5f);
+            processor.fadeUp(0.0);
+            settle(processor, scratch, midi);
+            break;
+
+        case State::Silent:
+            processor.setGainRange(0.0f, 1.0f);
+            processor.fadeDown(0.0);
+            settle(processor, scratch, midi);
+            break;
+
+        case State::Fading:
+            // Start from the bottom of the range and fade up slowly enough
+            // that the fade never finishes during the benchmark
+            processor.setGainRange(0.0f, 1.0f);
+            processor.fadeDown(0.0);
+            settle(processor, scratch, midi);
+            processor.fadeUp(10000.0);
+            break;
+
+        case State::FadeEndingMidBlock:
+            // Sit at the top of the range and fade down over half a block
+            processor.setGainRange(0.0f, 1.0f);
+            processor.fadeUp(0.0);
+            settle(processor, scratch, midi);
+            processor.fadeDown(blockSize / 2 / benchSampleRate);
+            break;
+    }
+}
+
+/**
+ * Benchmarks one combination of precision, layout, state and block size.
+ */
+template <typename SampleType>
+juce::var runBenchmark(const Layout &layout, State state, FadeCurve::Shape curve, int blockSize, int totalSamples, bool metering){
+    constexpr bool isDouble = std::is_same<SampleType, double>::value;
+
+    FaderVSTAudioProcessor processor;
+    setParameter(processor, "curve", (float) curve);
+    // Changes of the range take effect at once, so that the states are
+    // reached before the first timed block rather than glided to during it
+    setParameter(processor, "smoothing", 0.0f);
+    processor.setMeteringEnabled(metering);
+    processor.setProcessingPrecision(isDouble ? juce::AudioProcessor::doublePrecision
+                                              : juce::AudioProcessor::singlePrecision);
+
+    // The sidechain keeps its default (disabled) layout
+    auto busesLayout = processor.getBusesLayout();
+    busesLayout.inputBuses.set(0, layout.channels);
+    busesLayout.outputBuses.set(0, layout.channels);
+    if (! processor.setBusesLayout(busesLayout)){
+        return {};
+    }
+
+    processor.prepareToPlay(benchSampleRate, blockSize);
+
+    const int numChannels = layout.channels.size();
+
+    // The input signal is regenerated before every block, because the
+    // processing happens in place
+    juce::AudioBuffer<SampleType> input(numChannels, blockSize);
+    juce::Random random(0x46414445);
+    for (int channel = 0; channel < numChannels; ++channel){
+        for (int sample = 0; sample < blockSize; ++sample){
+            input.setSample(channel, sample, (SampleType) (random.nextFloat() * 2.0f - 1.0f));
+        }
+    }
+
+    juce::AudioBuffer<SampleType> buffer(numChannels, blockSize);
+    juce::AudioBuffer<SampleType> scratch(numChannels, blockSize);
+    juce::MidiBuffer midi;
+
+    const int iterations = juce::jmax(64, totalSamples / blockSize);
+
+    prepareState(processor, state, blockSize, scratch, midi);
+
+    double totalNanoseconds = 0.0;
+    uint64_t totalCycles = 0;
+    double minNanoseconds = std::numeric_limits<double>::max();
+
+    for (int i = 0; i < iterations; ++i){
+        if (state == State::FadeEndingMidBlock){
+            prepareState(processor, state, blockSize, scratch, midi);
+        }
+
+        buffer.makeCopyOf(input, true);
+
+        const auto startTime = Clock::now();
+        const auto startCycles = readCycleCounter();
+
+        processor.processBlock(buffer, midi);
+
+        const auto endCycles = readCycleCounter();
+        const auto endTime = Clock::now();
+
+        const double nanoseconds = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+        totalNanoseconds += nanoseconds;
+        totalCycles += endCycles - startCycles;
+        minNanoseconds = juce::jmin(minNanoseconds, nanoseconds);
+    }
+
+    processor.releaseResources();
+
+    const double nsPerBlock = totalNanoseconds / iterations;
+
+    auto *result = new juce::DynamicObject();
+    result->setProperty("precision", isDouble ? "double" : "float");
+    result->setProperty("layout", layout.name);
+    result->setProperty("channels", numChannels);
+    result->setProperty("state", getStateName(state));
+    result->setProperty("curve", FadeCurve::getNames()[curve]);
+    result->setProperty("blockSize", blockSize);
+    result->setProperty("iterations", iterations);
+    result->setProperty("nsPerBlock", nsPerBlock);
+    result->setProperty("minNsPerBlock", minNanoseconds);
+    result->setProperty("nsPerSample", nsPerBlock / blockSize);
+    result->setProperty("cyclesPerCall", (double) totalCycles / iterations);
+    return juce::var(result);
+}
+
+/**
+ * Opens and closes a number of editors one after the other, timing how long
+ * each one takes to be created. The first one stays open meanwhile, like the
+ * editor of another instance, so that the others share its typefaces.
+ */
+juce::var runEditorBenchmark(int numEditors){
+    FaderVSTAudioProcessor processor;
+    std::unique_ptr<juce::AudioProcessorEditor> firstEditor;
+
+    double firstNanoseconds = 0.0;
+    double totalNanoseconds = 0.0;
+    double maxNanoseconds = 0.0;
+
+    for (int i = 0; i < numEditors; ++i){
+        const auto startTime = Clock::now();
+        std::unique_ptr<juce::AudioProcessorEditor> editor(processor.createEditor());
+        const auto endTime = Clock::now();
+
+        const double nanoseconds = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count();
+        if (i == 0){
+            firstNanoseconds = nanoseconds;
+            firstEditor = std::move(editor);
+        } else {
+            totalNanoseconds += nanoseconds;
+            maxNanoseconds = juce::jmax(maxNanoseconds, nanoseconds);
+        }
+    }
+
+    auto *result = new juce::DynamicObject();
+    result->setProperty("editors", numEditors);
+    result->setProperty("firstOpenMs", firstNanoseconds / 1.0e6);
+    result->setProperty("averageOpenMs", numEditors > 1 ? totalNanoseconds / (numEditors - 1) / 1.0e6 : 0.0);
+    result->setProperty("maxOpenMs", maxNanoseconds / 1.0e6);
+    return juce::var(result);
+}
+
+/**
+ * Sends OSC messages to a processor from a client on the loopback interface,
+ * processing blocks of 64 samples in between like an audio thread would.
+ *
+ * Sets received to the number of messages that reached the audio thread.
+ */
+juce::var runOscLoopback(int numMessages, int &received){
+    constexpr int blockSize = 64;
+
+    FaderVSTAudioProcessor processor;
+    processor.prepareToPlay(benchSampleRate, blockSize);
+
+    // Find a free port
+    int port = 0;
+    for (int candidate = 19000; candidate < 19100 && port == 0; ++candidate){
+        if (processor.setOscPort(candidate)) port = candidate;
+    }
+
+    received = 0;
+    auto *result = new juce::DynamicObject();
+    result->setProperty("messages", numMessages);
+    if (port == 0){
+        result->setProperty("error", "no free port");
+        return juce::var(result);
+    }
+
+    juce::DatagramSocket client;
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    juce::MidiBuffer midi;
+    char packet[64];
+
+    for (int i = 0; i < numMessages; ++i){
+        // Alternate between fading down and up, instantly
+        const int size = OscRemote::writeMessage(packet, (int) sizeof(packet), i % 2 == 0 ? "/fadeDown" : "/fadeUp", { 0.0f });
+        client.write("127.0.0.1", port, packet, size);
+
+        // Keep processing until the message has been picked up, or give up
+        // after a second
+        const auto deadline = Clock::now() + std::chrono::seconds(1);
+        while (processor.getOscLatency().count <= i && Clock::now() < deadline){
+            buffer.clear();
+            processor.processBlock(buffer, midi);
+            juce::Thread::yield();
+        }
+    }
+
+    processor.setOscPort(0);
+
+    const auto latency = processor.getOscLatency();
+    received = (int) latency.count;
+    result->setProperty("port", port);
+    result->setProperty("received", received);
+    result->setProperty("averageLatencyMs", latency.average);
+    result->setProperty("maxLatencyMs", latency.max);
+    return juce::var(result);
+}
+
+/**
+ * Renders a fixed script of fades, per-channel fades, gain changes (also
+ * outside of the range, and together with the fading) and range changes in
+ * blocks of a size, and returns the output.
+ */
+template <typename SampleType>
+juce::AudioBuffer<SampleType> renderScript(FadeCurve::Shape curve, int blockSize){
+    constexpr int numChannels = 2;
+    constexpr int length = 1 << 16;
+
+    FaderVSTAudioProcessor processor;
+    setParameter(processor, "curve", (float) curve);
+    processor.setProcessingPrecision(std::is_same<SampleType, double>::value ? juce::AudioProcessor::doublePrecision
+                                                                             : juce::AudioProcessor::singlePrecision);
+    processor.prepareToPlay(benchSampleRate, blockSize);
+
+    const auto command = [](FadeCommand::Target target, double duration, juce::int64 timestamp, float value = 0.0f, juce::uint32 channels = 0){
+        FadeCommand result { target, duration, timestamp, false, true };
+        result.value = value;
+        result.channels = channels;
+        return result;
+    };
+
+    // In the order of their timestamps, like the queue expects
+    for (const auto &scripted : {
+        command(FadeCommand::Down, 0.25, 1000),
+        command(FadeCommand::SetGain, 0.0, 20000, 0.8f),
+        command(FadeCommand::Up, 0.1, 26000, 0.0f, 1),
+        command(FadeCommand::SetGainLow, 0.0, 33333, 0.3f),
+        command(FadeCommand::Toggle, 0.2, 40000),
+        command(FadeCommand::SetGain, 0.0, 46001, 0.1f),
+        command(FadeCommand::Down, 0.3, 50000, 0.0f, 2),
+        command(FadeCommand::Stop, 0.0, 55555),
+        command(FadeCommand::SetGainHigh, 0.0, 60000, 0.5f),
+        command(FadeCommand::SetGain, 0.0, 62000, 0.2f),
+        command(FadeCommand::SetFading, 0.0, 62010, 1.0f),
+    }){
+        processor.postFadeCommand(scripted);
+    }
+
+    juce::AudioBuffer<SampleType> output(numChannels, length);
+    juce::Random random(0x46414445);
+    for (int channel = 0; channel < numChannels; ++channel){
+        for (int sample = 0; sample < length; ++sample){
+            output.setSample(channel, sample, (SampleType) (random.nextFloat() * 2.0f - 1.0f));
+        }
+    }
+
+    juce::MidiBuffer midi;
+    for (int position = 0; position < length; position += blockSize){
+        juce::AudioBuffer<SampleType> block(output.getArrayOfWritePointers(), numChannels, position, juce::jmin(blockSize, length - position));
+        processor.processBlock(block, midi);
+    }
+
+    processor.releaseResources();
+    return output;
+}
+
+/**
+ * Renders the script in small and large blocks, and compares the outputs.
+ * Sets identical to false if any sample differs in any bit.
+ */
+template <typename SampleType>
+juce::var checkBlockSizes(FadeCurve::Shape curve, bool &identical){
+    const auto small = renderScript<SampleType>(curve, 32);
+    const auto large = renderScript<SampleType>(curve, 4096);
+
+    int firstDifference = -1;
+    for (int channel = 0; channel < small.getNumChannels() && firstDifference < 0; ++channel){
+        const auto *a = small.getReadPointer(channel);
+        const auto *b = large.getReadPointer(channel);
+        for (int sample = 0; sample < small.getNumSamples(); ++sample){
+            if (std::memcmp(a + sample, b + sample, sizeof(SampleType)) != 0){
+                firstDifference = sample;
+                break;
+            }
+        }
+    }
+
+    identical = identical && firstDifference < 0;
+
+    auto *result = new juce::DynamicObject();
+    result->setProperty("precision", std::is_same<SampleType, double>::value ? "double" : "float");
+    result->setProperty("curve", FadeCurve::getNames()[curve]);
+    result->setProperty("identical", firstDifference < 0);
+    result->setProperty("firstDifference", firstDifference);
+    return juce::var(result);
+}
+
+/**
+ * Returns the exit code of a run, failing it if the audio thread was caught
+ * allocating or blocking.
+ */
+int checkRealtimeSafety(int exitCode){
+#if FADERVST_RT_AUDIT
+    if (RealtimeAudit::getNumViolations() > 0){
+        RealtimeAudit::dump(std::cerr);
+        return 1;
+    }
+#endif
+    return exitCode;
+}
+
+}
+
+int main(int argc, char *argv[]){
+#if FADERVST_RT_AUDIT
+    RealtimeAudit::initialise();
+#endif
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    const juce::ArgumentList arguments(argc, argv);
+    const bool quick = arguments.containsOption("--quick");
+    const bool metering = arguments.containsOption("--metering");
+
+    if (arguments.containsOption("--osc-loopback")){
+        const int numMessages = quick ? 64 : 1024;
+        int received = 0;
+
+        auto *report = new juce::DynamicObject();
+        report->setProperty("osc", runOscLoopback(numMessages, received));
+        std::cout << juce::JSON::toString(juce::var(report)) << std::endl;
+
+        return checkRealtimeSafety(received == numMessages ? 0 : 1);
+    }
+
+    if (arguments.containsOption("--check-block-sizes")){
+        bool identical = true;
+        juce::Array<juce::var> results;
+        for (int curve = 0; curve < FadeCurve::getNames().size(); ++curve){
+            results.add(checkBlockSizes<float>((FadeCurve::Shape) curve, identical));
+            results.add(checkBlockSizes<double>((FadeCurve::Shape) curve, identical));
+        }
+
+        auto *report = new juce::DynamicObject();
+        report->setProperty("blockSizes", results);
+        std::cout << juce::JSON::toString(juce::var(report)) << std::endl;
+
+        return checkRealtimeSafety(identical ? 0 : 1);
+    }
+
+    /** How many samples (per channel) to push through each benchmark. */
+    const int totalSamples = quick ? (1 << 16) : (1 << 21);
+
+    const Layout layouts[] = {
+        { "mono", juce::AudioChannelSet::mono() },
+        { "stereo", juce::AudioChannelSet::stereo() },
+        { "5.1", juce::AudioChannelSet::create5point1() },
+        { "7.1.4", juce::AudioChannelSet::create7point1point4() },
+        { "ambisonic3", juce::AudioChannelSet::ambisonic(3) },
+    };
+
+    const State states[] = {
+        State::Unity,
+        State::Steady,
+        State::Silent,
+        State::Fading,
+        State::FadeEndingMidBlock,
+    };
+
+    juce::Array<juce::var> results;
+
+    for (const auto &layout : layouts){
+        for (auto state : states){
+            // The curve only makes a difference while fading
+            const bool isFading = state == State::Fading || state == State::FadeEndingMidBlock;
+            const int numCurves = isFading ? FadeCurve::getNames().size() : 1;
+
+            for (int curve = 0; curve < numCurves; ++curve){
+                for (int blockSize = 16; blockSize <= 8192; blockSize *= 2){
+                    for (auto result : { runBenchmark<float>(layout, state, (FadeCurve::Shape) curve, blockSize, totalSamples, metering),
+                                         runBenchmark<double>(layout, state, (FadeCurve::Shape) curve, blockSize, totalSamples, metering) }){
+                        if (! result.isVoid()){
+                            results.add(result);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    auto *report = new juce::DynamicObject();
+    report->setProperty("sampleRate", benchSampleRate);
+    report->setProperty("metering", metering);
+    report->setProperty("results", results);
+    report->setProperty("editor", runEditorBenchmark(quick ? 8 : 64));
+
+    std::cout << juce::JSON::toString(juce::var(report)) << std::endl;
+
+    return checkRealtimeSafety(0);
+}
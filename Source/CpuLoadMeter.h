@@ -0,0 +1,225 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_core/juce_core.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+/*
+ * Whether processBlock is measured, set by the FADERVST_CPU_METER option of
+ * CMake. When it is 0, none of the measuring code is compiled.
+ */
+#ifndef FADERVST_CPU_METER
+ #define FADERVST_CPU_METER 0
+#endif
+
+/**
+ * Measures how long processBlock takes, without locking or allocating.
+ *
+ * Every call is recorded by the audio thread in two histograms, one of the
+ * time it took and one of the share of the real-time budget of the block it
+ * used, from which the statistics can be read on any thread.
+ */
+class CpuLoadMeter {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	struct Stats {
+		/** The number of calls measured. */
+		juce::int64 numCalls = 0;
+
+		/** The time per call, in nanoseconds. */
+		double minTime = 0.0;
+		double averageTime = 0.0;
+		double p99Time = 0.0;
+		double maxTime = 0.0;
+
+		/** The average time per sample, in nanoseconds. */
+		double timePerSample = 0.0;
+
+		/** The share of the real-time budget used by a call, in percent. */
+		double minLoad = 0.0;
+		double averageLoad = 0.0;
+		double p99Load = 0.0;
+		double maxLoad = 0.0;
+	};
+
+	/**
+	 * Measures the lifetime of the object as one call.
+	 */
+	class ScopedMeasurement {
+	public:
+		ScopedMeasurement(CpuLoadMeter &meter, int numSamples, double sampleRate)
+			: meter(meter), numSamples(numSamples), sampleRate(sampleRate), start(Clock::now()) {}
+
+		~ScopedMeasurement(){
+			const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+			meter.record((double) elapsed.count(), numSamples, sampleRate);
+		}
+
+	private:
+		CpuLoadMeter &meter;
+		int numSamples;
+		double sampleRate;
+		Clock::time_point start;
+
+		JUCE_DECLARE_NON_COPYABLE(ScopedMeasurement)
+	};
+
+	/**
+	 * Records a call. Only called from the audio thread.
+	 */
+	void record(double time, int numSamples, double sampleRate){
+		if (resetRequested.exchange(false, std::memory_order_acquire)){
+			clear();
+		}
+
+		if (numSamples <= 0) return;
+
+		const double budget = numSamples / sampleRate * 1.0e9;
+		const double load = time / budget * 100.0;
+
+		// Only the audio thread writes, so plain loads and stores are enough
+		add(timeBins[(size_t) getTimeBin(time)], 1);
+		add(loadBins[(size_t) getLoadBin(load)], 1);
+		add(numCalls, 1);
+		add(totalSamples, numSamples);
+		add(totalTime, time);
+		add(totalLoad, load);
+
+		if (numCalls.load(std::memory_order_relaxed) == 1){
+			minTime.store(time, std::memory_order_relaxed);
+			minLoad.store(load, std::memory_order_relaxed);
+		} else {
+			if (time < minTime.load(std::memory_order_relaxed)) minTime.store(time, std::memory_order_relaxed);
+			if (load < minLoad.load(std::memory_order_relaxed)) minLoad.store(load, std::memory_order_relaxed);
+		}
+		if (time > maxTime.load(std::memory_order_relaxed)) maxTime.store(time, std::memory_order_relaxed);
+		if (load > maxLoad.load(std::memory_order_relaxed)) maxLoad.store(load, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Computes the statistics of the calls recorded so far.
+	 *
+	 * The values are read while the audio thread may be writing them, so
+	 * they can be off by the last call.
+	 */
+	Stats getStats() const {
+		Stats stats;
+		stats.numCalls = numCalls.load(std::memory_order_relaxed);
+		if (stats.numCalls == 0) return stats;
+
+		stats.minTime = minTime.load(std::memory_order_relaxed);
+		stats.maxTime = maxTime.load(std::memory_order_relaxed);
+		stats.averageTime = totalTime.load(std::memory_order_relaxed) / stats.numCalls;
+		stats.timePerSample = totalTime.load(std::memory_order_relaxed) / juce::jmax((juce::int64) 1, totalSamples.load(std::memory_order_relaxed));
+		stats.p99Time = juce::jmin(stats.maxTime, getTimeOfBin(getPercentileBin(timeBins, 0.99) + 1));
+
+		stats.minLoad = minLoad.load(std::memory_order_relaxed);
+		stats.maxLoad = maxLoad.load(std::memory_order_relaxed);
+		stats.averageLoad = totalLoad.load(std::memory_order_relaxed) / stats.numCalls;
+		stats.p99Load = juce::jmin(stats.maxLoad, (getPercentileBin(loadBins, 0.99) + 1) * loadBinWidth);
+
+		return stats;
+	}
+
+	/**
+	 * Forgets the calls recorded so far, before the next one is recorded.
+	 */
+	void reset(){
+		resetRequested.store(true, std::memory_order_release);
+	}
+
+private:
+	/*
+	 * The times are binned on a logarithmic scale, with 8 bins per octave
+	 * starting from 64ns, and the loads linearly in steps of 0.25% up to
+	 * 400%. The last bin of each collects everything above it.
+	 */
+	static constexpr int binsPerOctave = 8;
+	static constexpr double minBinTime = 64.0;
+	static constexpr int numTimeBins = 24 * binsPerOctave;
+	static constexpr double loadBinWidth = 0.25;
+	static constexpr int numLoadBins = 1600;
+
+	std::array<std::atomic<juce::uint32>, numTimeBins> timeBins {};
+	std::array<std::atomic<juce::uint32>, numLoadBins> loadBins {};
+
+	std::atomic<juce::int64> numCalls { 0 };
+	std::atomic<juce::int64> totalSamples { 0 };
+	std::atomic<double> totalTime { 0.0 };
+	std::atomic<double> totalLoad { 0.0 };
+	std::atomic<double> minTime { 0.0 };
+	std::atomic<double> maxTime { 0.0 };
+	std::atomic<double> minLoad { 0.0 };
+	std::atomic<double> maxLoad { 0.0 };
+
+	std::atomic<bool> resetRequested { false };
+
+	template <typename Type, typename Amount>
+	static void add(std::atomic<Type> &value, Amount amount){
+		value.store(value.load(std::memory_order_relaxed) + (Type) amount, std::memory_order_relaxed);
+	}
+
+	static int getTimeBin(double time){
+		if (time <= minBinTime) return 0;
+		return juce::jmin(numTimeBins - 1, (int) (std::log2(time / minBinTime) * binsPerOctave));
+	}
+
+	static double getTimeOfBin(int bin){
+		return minBinTime * std::exp2((double) bin / binsPerOctave);
+	}
+
+	static int getLoadBin(double load){
+		return juce::jlimit(0, numLoadBins - 1, (int) (load / loadBinWidth));
+	}
+
+	/**
+	 * Finds the bin that contains a percentile of the calls.
+	 */
+	template <size_t numBins>
+	int getPercentileBin(const std::array<std::atomic<juce::uint32>, numBins> &bins, double percentile) const {
+		const auto target = (juce::int64) std::ceil(numCalls.load(std::memory_order_relaxed) * percentile);
+
+		juce::int64 count = 0;
+		for (size_t bin = 0; bin < numBins; ++bin){
+			count += bins[bin].load(std::memory_order_relaxed);
+			if (count >= target) return (int) bin;
+		}
+
+		return (int) numBins - 1;
+	}
+
+	void clear(){
+		for (auto &bin : timeBins) bin.store(0, std::memory_order_relaxed);
+		for (auto &bin : loadBins) bin.store(0, std::memory_order_relaxed);
+		numCalls.store(0, std::memory_order_relaxed);
+		totalSamples.store(0, std::memory_order_relaxed);
+		totalTime.store(0.0, std::memory_order_relaxed);
+		totalLoad.store(0.0, std::memory_order_relaxed);
+		minTime.store(0.0, std::memory_order_relaxed);
+		maxTime.store(0.0, std::memory_order_relaxed);
+		minLoad.store(0.0, std::memory_order_relaxed);
+		maxLoad.store(0.0, std::memory_order_relaxed);
+	}
+};
@@ -0,0 +1,228 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_core/juce_core.h>
+#include "FadeCommandQueue.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+/**
+ * A fade that happens at a fixed point of the timeline of the host.
+ */
+struct Cue {
+	/** The position on the timeline, in seconds. */
+	double time = 0.0;
+
+	/** The kind of fade. */
+	FadeCommand::Target target = FadeCommand::Toggle;
+
+	/** The duration of the fade, in the unit of FadeCommand::duration. */
+	double duration = 1.0;
+
+	bool operator<(const Cue &other) const {
+		return time < other.time;
+	}
+};
+
+/**
+ * An ordered list of cues, edited on the message thread and played back by
+ * the audio thread.
+ *
+ * The audio thread walks the list with a cursor, doing constant work per
+ * block. When the transport relocates, the audio thread asks the message
+ * thread for the new position of the cursor, which is found with a binary
+ * search and handed back through an atomic.
+ *
+ * A new version of the list is handed to the audio thread through an atomic
+ * pointer, and the version it replaces is handed back to the message thread
+ * to be deleted, so the audio thread never allocates or frees memory.
+ */
+class CueList {
+public:
+	~CueList(){
+		delete pending.exchange(nullptr);
+		delete retired.exchange(nullptr);
+		delete active;
+	}
+
+	/**
+	 * Replaces the cues. Called from the message thread.
+	 */
+	void setCues(std::vector<Cue> newCues){
+		std::stable_sort(newCues.begin(), newCues.end());
+		cues = newCues;
+
+		// A version that the audio thread has not picked up yet can be
+		// deleted right away
+		delete pending.exchange(new std::vector<Cue>(std::move(newCues)), std::memory_order_acq_rel);
+	}
+
+	/**
+	 * Returns the cues, in order. Called from the message thread.
+	 */
+	const std::vector<Cue>& getCues() const {
+		return cues;
+	}
+
+	/**
+	 * Answers the requests of the audio thread and deletes the versions of
+	 * the list it no longer uses. Called periodically from the message
+	 * thread.
+	 */
+	void update(){
+		delete retired.exchange(nullptr, std::memory_order_acq_rel);
+
+		const double time = seekTime.exchange(std::numeric_limits<double>::quiet_NaN());
+		if (! std::isnan(time)){
+			const auto cue = std::lower_bound(cues.begin(), cues.end(), Cue { time });
+			seekResult.store((int) std::distance(cues.begin(), cue), std::memory_order_release);
+		}
+	}
+
+	/**
+	 * Finds the cues that fall inside a block while the transport is
+	 * rolling, and calls fire(cue, offset) for each one, in order. Called
+	 * from the audio thread.
+	 *
+	 * position is the time of the first sample of the block on the timeline,
+	 * and relocated should be true if the transport has just started or
+	 * jumped. Cues that were passed while waiting for the message thread
+	 * after a relocation are fired at the start of the block.
+	 */
+	template <typename Callback>
+	void process(double position, int numSamples, double sampleRate, bool relocated, Callback &&fire){
+		// Pick up a new version of the list, once the previous one that was
+		// replaced has been deleted
+		if (retired.load(std::memory_order_acquire) == nullptr){
+			if (auto *newCues = pending.exchange(nullptr, std::memory_order_acq_rel)){
+				retired.store(active, std::memory_order_release);
+				active = newCues;
+				relocated = true;
+			}
+		}
+
+		if (active == nullptr) return;
+
+		if (relocated){
+			requestSeek(position);
+		}
+
+		if (! cursorValid){
+			const int result = seekResult.exchange(-1, std::memory_order_acq_rel);
+			if (result < 0) return;
+
+			// The result may be for an older request or an older version of
+			// the list, so it is only used if it is where a binary search
+			// for the requested time would land
+			const auto index = (size_t) result;
+			const bool afterPrevious = index == 0 || (index <= active->size() && (*active)[index - 1].time < cursorTime);
+			const bool beforeNext = index >= active->size() || (*active)[index].time >= cursorTime;
+
+			if (! afterPrevious || ! beforeNext){
+				requestSeek(cursorTime);
+				return;
+			}
+
+			cursor = index;
+			cursorValid = true;
+		}
+
+		const double end = position + numSamples / sampleRate;
+		while (cursor < active->size() && (*active)[cursor].time < end){
+			const auto &cue = (*active)[cursor];
+			fire(cue, juce::jlimit(0, numSamples - 1, (int) std::floor((cue.time - position) * sampleRate)));
+			++cursor;
+		}
+	}
+
+	/**
+	 * Reads cues from text, with one cue per line in the form
+	 * "time, action, duration", where the action is one of "fade", "down",
+	 * "up" or "stop". Empty lines and lines starting with # are skipped.
+	 */
+	static std::vector<Cue> parse(const juce::String &text){
+		std::vector<Cue> result;
+
+		for (const auto &line : juce::StringArray::fromLines(text)){
+			const auto trimmed = line.trim();
+			if (trimmed.isEmpty() || trimmed.startsWithChar('#')) continue;
+
+			const auto fields = juce::StringArray::fromTokens(trimmed, ",", "");
+			if (fields.size() < 2) continue;
+
+			const auto action = fields[1].trim().toLowerCase();
+
+			Cue cue;
+			cue.time = fields[0].trim().getDoubleValue();
+			if (action == "down"){
+				cue.target = FadeCommand::Down;
+			} else if (action == "up"){
+				cue.target = FadeCommand::Up;
+			} else if (action == "stop"){
+				cue.target = FadeCommand::Stop;
+			}
+			if (fields.size() > 2){
+				cue.duration = fields[2].trim().getDoubleValue();
+			}
+
+			result.push_back(cue);
+		}
+
+		return result;
+	}
+
+private:
+	/** The cues, as edited on the message thread. */
+	std::vector<Cue> cues;
+
+	/** A new version of the list, waiting for the audio thread. */
+	std::atomic<std::vector<Cue>*> pending { nullptr };
+
+	/** A version replaced by the audio thread, waiting to be deleted. */
+	std::atomic<std::vector<Cue>*> retired { nullptr };
+
+	/** The time to find the cursor for, or NaN if there is none. */
+	std::atomic<double> seekTime { std::numeric_limits<double>::quiet_NaN() };
+
+	/** The cursor found for seekTime, or -1 if there is none. */
+	std::atomic<int> seekResult { -1 };
+
+	/*
+	 * The version of the list being played and the position in it. Only
+	 * accessed by the audio thread.
+	 */
+	std::vector<Cue> *active = nullptr;
+	size_t cursor = 0;
+	bool cursorValid = false;
+	/** The time of the last seek that was requested. */
+	double cursorTime = 0.0;
+
+	void requestSeek(double time){
+		cursorValid = false;
+		cursorTime = time;
+		seekResult.store(-1, std::memory_order_relaxed);
+		seekTime.store(time, std::memory_order_release);
+	}
+};
@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_core/juce_core.h>
+#include <array>
+
+/**
+ * A request to change the state of the fading, sent to the audio thread.
+ */
+struct FadeCommand {
+	enum Target {
+		/** Fade towards the opposite end of the gain range. */
+		Toggle,
+		/** Fade towards the low gain. */
+		Down,
+		/** Fade towards the high gain. */
+		Up,
+		/** End the current fade immediately. */
+		Stop,
+		/** Set the "gain" parameter to value, like an outside change. */
+		SetGain,
+		/** Set the "fading" parameter to value, like an outside change. */
+		SetFading,
+		/** Set the low end of the gain range to value. */
+		SetGainLow,
+		/** Set the high end of the gain range to value. */
+		SetGainHigh,
+	};
+
+	Target target = Toggle;
+
+	/**
+	 * The duration of a fade across the whole gain range, in the unit chosen
+	 * by the "durationUnit" parameter (seconds, unless the fades follow the
+	 * tempo of the host).
+	 */
+	double duration = 0.0;
+
+	/**
+	 * The sample at which the command takes effect, counted on the sample
+	 * clock of the processor.
+	 *
+	 * Commands with a timestamp that has already passed take effect at the
+	 * start of the next block.
+	 */
+	juce::int64 timestamp = 0;
+
+	/**
+	 * Whether the command may be moved to the next beat or bar, when the
+	 * fades are synchronised to the transport of the host. Cleared once a
+	 * command has been moved.
+	 */
+	bool quantisable = true;
+
+	/**
+	 * Whether the duration is in seconds, whatever the unit chosen by the
+	 * "durationUnit" parameter.
+	 */
+	bool durationInSeconds = false;
+
+	/** The new value of the parameter, for the Set targets. */
+	float value = 0.0f;
+
+	/**
+	 * The channels that the command fades, as a mask with a bit per channel
+	 * (see FadeEngine::maxLanes), or 0 for all of them.
+	 */
+	juce::uint32 channels = 0;
+
+	/**
+	 * The number of samples of the fade that have already passed when it
+	 * takes effect, for a fade that was meant to start earlier (see
+	 * FadeGroupMember::process()).
+	 */
+	juce::int64 elapsed = 0;
+};
+
+/**
+ * A wait-free queue of fade commands with a single producer and a single
+ * consumer.
+ *
+ * The producer is the thread that triggers fades (usually the message
+ * thread), and the consumer is the audio thread. Neither side ever blocks or
+ * allocates.
+ */
+class FadeCommandQueue {
+public:
+	/**
+	 * Adds a command to the back of the queue.
+	 *
+	 * Returns false, dropping the command, if the queue is full.
+	 */
+	bool push(const FadeCommand &command){
+		int start1, size1, start2, size2;
+		fifo.prepareToWrite(1, start1, size1, start2, size2);
+		if (size1 + size2 == 0) return false;
+
+		commands[(size_t) (size1 > 0 ? start1 : start2)] = command;
+		fifo.finishedWrite(1);
+		return true;
+	}
+
+	/**
+	 * Copies the command at the front of the queue without removing it.
+	 *
+	 * Returns false if the queue is empty.
+	 */
+	bool peek(FadeCommand &command) const {
+		int start1, size1, start2, size2;
+		fifo.prepareToRead(1, start1, size1, start2, size2);
+		if (size1 + size2 == 0) return false;
+
+		command = commands[(size_t) (size1 > 0 ? start1 : start2)];
+		return true;
+	}
+
+	/**
+	 * Removes the command at the front of the queue.
+	 *
+	 * Must only be called after peek() has returned true.
+	 */
+	void pop(){
+		fifo.finishedRead(1);
+	}
+
+private:
+	static constexpr int capacity = 64;
+
+	juce::AbstractFifo fifo { capacity };
+
+	std::array<FadeCommand, capacity> commands;
+};
@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_core/juce_core.h>
+#include <array>
+#include <cmath>
+
+/**
+ * The shapes a fade can follow between the low and the high gain.
+ *
+ * A fade is described by its phase, which goes from 0.0 at the low gain to
+ * 1.0 at the high gain. The shape maps the phase to a position inside the
+ * gain range, also between 0.0 and 1.0.
+ *
+ * Except for the linear shape, the shapes are evaluated from lookup tables
+ * that are computed once for the whole process, so rendering a fade costs
+ * about the same for every shape.
+ */
+namespace FadeCurve {
+
+	enum Shape {
+		/** The gain changes linearly. */
+		Linear,
+		/** The gain changes linearly in decibels, over a range of 60dB. */
+		Decibel,
+		/** The power of the signal changes linearly (a quarter sine). */
+		EqualPower,
+		/** The gain follows a raised cosine, easing in and out. */
+		SCurve,
+	};
+
+	/** The names of the shapes, in the order of the Shape enum. */
+	inline juce::StringArray getNames(){
+		return { "Linear", "Decibel", "Equal power", "S-curve" };
+	}
+
+	/** The range covered by the Decibel shape, as a gain ratio (-60dB). */
+	constexpr double decibelFloor = 0.001;
+
+	/**
+	 * Evaluates a shape exactly. Too slow to be used per sample.
+	 */
+	inline double evaluate(Shape shape, double phase){
+		switch (shape){
+			case Linear:
+				return phase;
+			case Decibel:
+				return (std::pow(10.0, 3.0 * (phase - 1.0)) - decibelFloor) / (1.0 - decibelFloor);
+			case EqualPower:
+				return std::sin(phase * juce::MathConstants<double>::halfPi);
+			case SCurve:
+				return 0.5 - 0.5 * std::cos(phase * juce::MathConstants<double>::pi);
+		}
+
+		return phase;
+	}
+
+	/**
+	 * Finds the phase at which a shape reaches a position in the gain range.
+	 */
+	inline double inverse(Shape shape, double position){
+		position = juce::jlimit(0.0, 1.0, position);
+
+		switch (shape){
+			case Linear:
+				return position;
+			case Decibel:
+				return 1.0 + std::log10(position * (1.0 - decibelFloor) + decibelFloor) / 3.0;
+			case EqualPower:
+				return std::asin(position) / juce::MathConstants<double>::halfPi;
+			case SCurve:
+				return std::acos(1.0 - 2.0 * position) / juce::MathConstants<double>::pi;
+		}
+
+		return position;
+	}
+
+	/** The number of intervals in each lookup table. */
+	constexpr int tableSize = 1024;
+
+	/**
+	 * A shape sampled at tableSize + 1 evenly spaced phases, plus a copy of
+	 * the last value so that interpolating at a phase of exactly 1.0 stays
+	 * inside the table.
+	 */
+	using Table = std::array<float, tableSize + 2>;
+
+	/**
+	 * Returns the lookup table of a shape.
+	 *
+	 * The tables are built on the first call, which should not happen on the
+	 * audio thread.
+	 */
+	inline const Table& getTable(Shape shape){
+		static const auto tables = [](){
+			std::array<Table, 4> result;
+			for (int s = 0; s < (int) result.size(); ++s){
+				for (int i = 0; i <= tableSize; ++i){
+					result[(size_t) s][(size_t) i] = (float) evaluate((Shape) s, (double) i / tableSize);
+				}
+				result[(size_t) s][tableSize + 1] = result[(size_t) s][tableSize];
+			}
+			return result;
+		}();
+
+		return tables[(size_t) shape];
+	}
+
+	/**
+	 * Computes the gain for a number of consecutive samples of a fade.
+	 *
+	 * The phase of the first sample is given in phase, which is advanced by
+	 * step for every sample and is left at the phase of the sample after the
+	 * last one. The gains are written to dest.
+	 */
+	template <Shape shape, typename SampleType>
+	void render(SampleType *dest, int numSamples, double &phase, double step, float low, float high){
+		const SampleType base = low;
+		const SampleType range = (SampleType) high - (SampleType) low;
+
+		if constexpr (shape == Linear){
+			for (int i = 0; i < numSamples; ++i){
+				dest[i] = base + range * (SampleType) phase;
+				phase += step;
+			}
+		} else {
+			const float *table = getTable(shape).data();
+
+			for (int i = 0; i < numSamples; ++i){
+				const double position = juce::jlimit(0.0, 1.0, phase) * tableSize;
+				const int index = (int) position;
+				const auto fraction = (SampleType) (position - index);
+				const auto value = (SampleType) table[index] + fraction * (SampleType) (table[index + 1] - table[index]);
+
+				dest[i] = base + range * value;
+				phase += step;
+			}
+		}
+	}
+
+	/**
+	 * Calls the render() specialisation for a shape chosen at run time.
+	 */
+	template <typename SampleType>
+	void render(Shape shape, SampleType *dest, int numSamples, double &phase, double step, float low, float high){
+		switch (shape){
+			case Linear: render<Linear>(dest, numSamples, phase, step, low, high); break;
+			case Decibel: render<Decibel>(dest, numSamples, phase, step, low, high); break;
+			case EqualPower: render<EqualPower>(dest, numSamples, phase, step, low, high); break;
+			case SCurve: render<SCurve>(dest, numSamples, phase, step, low, high); break;
+		}
+	}
+
+	/**
+	 * Computes the gain at a single phase, using the lookup tables.
+	 */
+	inline float getGain(Shape shape, double phase, float low, float high){
+		float gain;
+		render(shape, &gain, 1, phase, 0.0, low, high);
+		return gain;
+	}
+}
@@ -0,0 +1,549 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "FadeCommandQueue.h"
+#include "FadeCurve.h"
+#include "ParameterSmoother.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <tuple>
+
+/**
+ * The state of the fader, and the gains it applies to every sample.
+ *
+ * Every channel (up to maxLanes, after which the channels follow the last
+ * one) has a lane with a fade state of its own, so that channels can be faded
+ * on different schedules. The states are kept as arrays with an element per
+ * lane, and the lanes that are in the same state are computed only once.
+ *
+ * The position along the fade curve is a double precision phase that is
+ * advanced by a fixed step on every sample, and the length of a fade is
+ * counted down in whole samples from the moment it starts. The gains of a
+ * run of samples therefore do not depend on how it is split into blocks,
+ * and every fade ends on exactly the sample it was meant to.
+ *
+ * Only used by the audio thread.
+ */
+class FadeEngine {
+public:
+	/** The number of channels that can be faded on their own. */
+	static constexpr int maxLanes = 16;
+
+	/**
+	 * The values of the parameters, read once per block.
+	 */
+	struct Parameters {
+		float low = 0.0f;
+		float high = 1.0f;
+		FadeCurve::Shape shape = FadeCurve::Linear;
+		/** How long changes of the range and the gain glide for. */
+		int smoothingSamples = 0;
+	};
+
+	FadeEngine(){
+		phases.fill(1.0);
+		steps.fill(0.0);
+		directions.fill(1.0f);
+		durations.fill(0);
+		remaining.fill(0);
+		quarterNotes.fill(0.0);
+		currentGains.fill(1.0f);
+	}
+
+	/**
+	 * Jumps to a range and a gain, without gliding.
+	 */
+	void reset(float low, float high, float gain){
+		lowSmoother.reset(low);
+		highSmoother.reset(high);
+		for (auto &smoother : gainSmoothers){
+			smoother.reset(gain);
+		}
+		parameters.low = low;
+		parameters.high = high;
+	}
+
+	/**
+	 * Jumps to the range of the parameters, sets the number of channels, and
+	 * converts the fades in progress to a new sample rate.
+	 */
+	void prepare(double newSampleRate, const Parameters &newParameters, int numChannels){
+		if (sampleRate > 0.0 && newSampleRate != sampleRate){
+			const double ratio = newSampleRate / sampleRate;
+			for (int lane = 0; lane < maxLanes; ++lane){
+				if (remaining[(size_t) lane] == 0) continue;
+				durations[(size_t) lane] = juce::jmax((juce::int64) 1, (juce::int64) std::llround((double) durations[(size_t) lane] * ratio));
+				remaining[(size_t) lane] = juce::jmax((juce::int64) 1, (juce::int64) std::llround((double) remaining[(size_t) lane] * ratio));
+			}
+		}
+		sampleRate = newSampleRate;
+
+		// New channels start in the state of the first one
+		const int newNumLanes = juce::jlimit(1, maxLanes, numChannels);
+		for (int lane = numLanes; lane < newNumLanes; ++lane){
+			copyLane(0, lane);
+		}
+		numLanes = newNumLanes;
+
+		parameters = newParameters;
+		lowSmoother.reset(parameters.low);
+		highSmoother.reset(parameters.high);
+	}
+
+	/**
+	 * Takes the values of the parameters for the next block. The range
+	 * glides to new values.
+	 */
+	void setParameters(const Parameters &newParameters){
+		parameters = newParameters;
+		lowSmoother.setTarget(parameters.low, parameters.smoothingSamples);
+		highSmoother.setTarget(parameters.high, parameters.smoothingSamples);
+	}
+
+	/**
+	 * Changes the range in the middle of a block (e.g. at the sample of an
+	 * automation event), gliding to it.
+	 */
+	void setRange(float low, float high){
+		auto newParameters = parameters;
+		newParameters.low = low;
+		newParameters.high = high;
+		setParameters(newParameters);
+	}
+
+	/**
+	 * Returns the ends of the range reached by their glides, at the end of
+	 * the samples computed so far.
+	 */
+	float getLow() const {
+		return lowSmoother.getCurrent();
+	}
+
+	float getHigh() const {
+		return highSmoother.getCurrent();
+	}
+
+	/** Returns the values of the parameters being used. */
+	const Parameters& getParameters() const {
+		return parameters;
+	}
+
+	/**
+	 * Glides every channel from its own gain to a gain set from outside,
+	 * stopping any fade and holding the point of the curve where the gain
+	 * lies afterwards.
+	 *
+	 * A gain outside of the range glides to the nearest end of it. The glide
+	 * ends on the gain of the point of the curve it holds, so that nothing
+	 * steps when the curve takes over again.
+	 */
+	void glideTo(float newGain){
+		const float low = parameters.low;
+		const float high = parameters.high;
+		newGain = juce::jlimit(juce::jmin(low, high), juce::jmax(low, high), newGain);
+
+		for (int lane = 0; lane < numLanes; ++lane){
+			if (high != low){
+				phases[(size_t) lane] = FadeCurve::inverse(parameters.shape, (newGain - low) / (high - low));
+			}
+			finishFade(lane, false);
+
+			auto &smoother = gainSmoothers[(size_t) lane];
+			smoother.reset(currentGains[(size_t) lane]);
+			smoother.setTarget(FadeCurve::getGain(parameters.shape, phases[(size_t) lane], low, high), parameters.smoothingSamples);
+		}
+	}
+
+	/**
+	 * Jumps every channel to an end of the range, given as a direction like
+	 * the "fading" parameter.
+	 *
+	 * A channel that is gliding to a gain set from outside (e.g. when the
+	 * gain and the fading are set together) glides on to the end instead.
+	 */
+	void jumpTo(float newDirection){
+		for (int lane = 0; lane < numLanes; ++lane){
+			const auto index = (size_t) lane;
+			directions[index] = newDirection;
+			finishFade(lane, true);
+
+			auto &smoother = gainSmoothers[index];
+			if (smoother.isSmoothing()){
+				smoother.reset(currentGains[index]);
+				smoother.setTarget(FadeCurve::getGain(parameters.shape, phases[index], parameters.low, parameters.high), parameters.smoothingSamples);
+			}
+		}
+	}
+
+	/**
+	 * Starts a fade across the whole range lasting for a number of samples,
+	 * or stops the fade in progress for FadeCommand::Stop.
+	 *
+	 * The channels are given as a mask with a bit per lane, or 0 for all of
+	 * them. A fade whose duration follows the tempo gives its length in
+	 * quarter notes, so that it can be kept in time by rescale(). A fade that
+	 * was meant to start elapsed samples ago starts at the point it would
+	 * have reached by now.
+	 */
+	void start(FadeCommand::Target target, double samples, juce::uint32 channels = 0, double newQuarterNotes = 0.0, juce::int64 elapsed = 0){
+		switch (target){
+			case FadeCommand::Toggle:
+			case FadeCommand::Down:
+			case FadeCommand::Up:
+			case FadeCommand::Stop:
+				break;
+			case FadeCommand::SetGain:
+			case FadeCommand::SetFading:
+			case FadeCommand::SetGainLow:
+			case FadeCommand::SetGainHigh:
+				// Changes of the parameters are not fades
+				return;
+		}
+
+		const auto duration = (juce::int64) std::llround(juce::jmax(0.0, samples));
+
+		for (int lane = 0; lane < numLanes; ++lane){
+			if (channels != 0 && (channels & (1u << lane)) == 0) continue;
+
+			const auto index = (size_t) lane;
+			switch (target){
+				case FadeCommand::Toggle: directions[index] = 1.0f - directions[index]; break;
+				case FadeCommand::Down: directions[index] = 0.0f; break;
+				case FadeCommand::Up: directions[index] = 1.0f; break;
+				default:
+					// Hold the gain where it is
+					finishFade(lane, false);
+					continue;
+			}
+
+			// A fade takes over from a manual change of the gain
+			gainSmoothers[index].reset(gainSmoothers[index].getTarget());
+
+			durations[index] = duration;
+			remaining[index] = (juce::int64) std::llround(std::abs(getEnd(lane) - phases[index]) * (double) duration);
+			quarterNotes[index] = newQuarterNotes;
+
+			if (elapsed > 0 && remaining[index] > 0){
+				const auto skipped = juce::jmin(elapsed, remaining[index]);
+				phases[index] += (directions[index] < 0.5f ? -1.0 : 1.0) * (double) skipped / (double) duration;
+				remaining[index] -= skipped;
+			}
+
+			// A fade shorter than a sample happens instantly
+			if (remaining[index] == 0){
+				finishFade(lane, true);
+			}
+		}
+	}
+
+	/**
+	 * Changes the lengths of the fades in progress that follow the tempo,
+	 * when it changes, keeping the points they have reached.
+	 */
+	void rescale(double samplesPerQuarterNote){
+		for (int lane = 0; lane < numLanes; ++lane){
+			const auto index = (size_t) lane;
+			if (remaining[index] == 0 || quarterNotes[index] <= 0.0) continue;
+
+			const auto newDuration = juce::jmax((juce::int64) 1, (juce::int64) std::llround(quarterNotes[index] * samplesPerQuarterNote));
+			remaining[index] = juce::jmax((juce::int64) 1, (juce::int64) std::llround((double) remaining[index] * (double) newDuration / (double) durations[index]));
+			durations[index] = newDuration;
+		}
+	}
+
+	/** Returns true while a fade is in progress on any channel. */
+	bool isFading() const {
+		for (int lane = 0; lane < numLanes; ++lane){
+			if (remaining[(size_t) lane] > 0) return true;
+		}
+		return false;
+	}
+
+	/** Returns the gain applied to the last sample of the first channel. */
+	float getCurrentGain() const {
+		return currentGains[0];
+	}
+
+	/**
+	 * Returns the direction of the fading of the first channel, like the
+	 * "fading" parameter.
+	 */
+	float getDirection() const {
+		return directions[0];
+	}
+
+	/**
+	 * Computes the gains of the next samples.
+	 *
+	 * Runs where the gain of every channel is constant are passed to
+	 * constant(gains, numGains, offset, count), with a gain per lane, and the
+	 * gains of the other samples to ramp(gains, numGains, lows, ranges,
+	 * offset, count), with the gains of each sample of each lane, and the low
+	 * end and the width of the range at each sample. Channels past
+	 * numGains - 1 take the gains of the last lane.
+	 */
+	template <typename SampleType, typename Constant, typename Ramp>
+	void process(int numSamples, Constant &&constant, Ramp &&ramp){
+		int done = 0;
+
+		while (done < numSamples){
+			const bool rangeSettled = ! lowSmoother.isSmoothing() && ! highSmoother.isSmoothing();
+			const bool fading = isFading();
+
+			if (! fading && rangeSettled && ! isGliding()){
+				// When nothing is moving, apply a constant gain to each lane
+				const int numGains = areLanesInSync() ? 1 : numLanes;
+				for (int lane = 0; lane < numGains; ++lane){
+					currentGains[(size_t) lane] = FadeCurve::getGain(parameters.shape, phases[(size_t) lane], lowSmoother.getCurrent(), highSmoother.getCurrent());
+				}
+				if (numGains == 1){
+					currentGains.fill(currentGains[0]);
+				}
+				constant(currentGains.data(), numGains, done, numSamples - done);
+				return;
+			}
+
+			/** How many samples to process before the state of a lane changes */
+			int samplesToProcess = numSamples - done;
+
+			// Glides also end a run, so that the samples after one are
+			// computed the same way whichever block they fall in
+			for (const auto *smoother : { &lowSmoother, &highSmoother }){
+				if (smoother->isSmoothing()){
+					samplesToProcess = juce::jmin(samplesToProcess, smoother->getRemaining());
+				}
+			}
+			for (int lane = 0; lane < numLanes; ++lane){
+				const auto &smoother = gainSmoothers[(size_t) lane];
+				if (smoother.isSmoothing()){
+					samplesToProcess = juce::jmin(samplesToProcess, smoother.getRemaining());
+				}
+			}
+
+			for (int lane = 0; lane < numLanes; ++lane){
+				const auto index = (size_t) lane;
+				if (remaining[index] > 0){
+					samplesToProcess = (int) juce::jmin((juce::int64) samplesToProcess, remaining[index]);
+					steps[index] = (directions[index] < 0.5f ? -1.0 : 1.0) / (double) durations[index];
+				} else {
+					steps[index] = 0.0;
+				}
+			}
+
+			renderGains<SampleType>(done, samplesToProcess, rangeSettled, ramp);
+			done += samplesToProcess;
+
+			if (fading){
+				for (int lane = 0; lane < numLanes; ++lane){
+					const auto index = (size_t) lane;
+					if (remaining[index] == 0) continue;
+
+					remaining[index] -= samplesToProcess;
+
+					// Land exactly on the end of the range
+					if (remaining[index] == 0){
+						finishFade(lane, true);
+					}
+				}
+			}
+		}
+	}
+
+private:
+	/** The number of samples the gains are computed for at once. */
+	static constexpr int chunkSize = 256;
+
+	/**
+	 * The values of each sample of a chunk, while the gain changes.
+	 */
+	template <typename SampleType>
+	struct Chunk {
+		/** The gains to apply to each sample, for every lane. */
+		std::array<std::array<SampleType, chunkSize>, maxLanes> gains;
+		/** The low end of the range at each sample. */
+		std::array<SampleType, chunkSize> lows;
+		/** The width of the range at each sample. */
+		std::array<SampleType, chunkSize> ranges;
+		/** Pointers to the gains of the lanes, as passed to the callback. */
+		std::array<const SampleType*, maxLanes> pointers;
+	};
+
+	/** The chunk buffers for single and double precision. */
+	std::tuple<Chunk<float>, Chunk<double>> chunks;
+
+	Parameters parameters;
+	double sampleRate = 0.0;
+
+	/** The number of lanes in use, one per channel. */
+	int numLanes = 1;
+
+	/** The gliding values of the ends of the range. */
+	ParameterSmoother lowSmoother;
+	ParameterSmoother highSmoother;
+
+	/*
+	 * The state of each lane.
+	 */
+
+	/** The gliding value of a gain set from outside. */
+	std::array<ParameterSmoother, maxLanes> gainSmoothers;
+
+	/**
+	 * The position of the gain inside the gain range, along the fade curve.
+	 * 0.0 is the low gain and 1.0 is the high gain.
+	 */
+	std::array<double, maxLanes> phases;
+
+	/** How much the phase changes on every sample of the current segment. */
+	std::array<double, maxLanes> steps;
+
+	/** The direction of the fading, with the meaning of the "fading" parameter. */
+	std::array<float, maxLanes> directions;
+
+	/** The length of a fade across the whole range, in samples. */
+	std::array<juce::int64, maxLanes> durations;
+
+	/** The samples left until the fade in progress ends, or 0 if there is none. */
+	std::array<juce::int64, maxLanes> remaining;
+
+	/** The length of the fade in quarter notes, or 0 if it is in seconds. */
+	std::array<double, maxLanes> quarterNotes;
+
+	/** The gain applied to the last sample. */
+	std::array<float, maxLanes> currentGains;
+
+	double getEnd(int lane) const {
+		return directions[(size_t) lane] < 0.5f ? 0.0 : 1.0;
+	}
+
+	/**
+	 * Ends the fade in progress on a lane, moving to the end of the range it
+	 * was heading to if atEnd is true.
+	 */
+	void finishFade(int lane, bool atEnd){
+		remaining[(size_t) lane] = 0;
+		durations[(size_t) lane] = 0;
+		if (atEnd){
+			phases[(size_t) lane] = getEnd(lane);
+		}
+	}
+
+	void copyLane(int from, int to){
+		phases[(size_t) to] = phases[(size_t) from];
+		directions[(size_t) to] = directions[(size_t) from];
+		durations[(size_t) to] = durations[(size_t) from];
+		remaining[(size_t) to] = remaining[(size_t) from];
+		quarterNotes[(size_t) to] = quarterNotes[(size_t) from];
+		currentGains[(size_t) to] = currentGains[(size_t) from];
+		gainSmoothers[(size_t) to] = gainSmoothers[(size_t) from];
+	}
+
+	/** Returns true while any channel glides to a gain set from outside. */
+	bool isGliding() const {
+		for (int lane = 0; lane < numLanes; ++lane){
+			if (gainSmoothers[(size_t) lane].isSmoothing()) return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Returns true if every lane is in the same state as the first one, so
+	 * that its gains can be used for all of them.
+	 */
+	bool areLanesInSync() const {
+		for (int lane = 1; lane < numLanes; ++lane){
+			const auto index = (size_t) lane;
+			if (phases[index] != phases[0] || remaining[index] != remaining[0]) return false;
+			if (remaining[0] > 0 && (directions[index] != directions[0] || durations[index] != durations[0])) return false;
+			if (! gainSmoothers[index].isInStepWith(gainSmoothers[0])) return false;
+		}
+		return true;
+	}
+
+	template <typename SampleType, typename Ramp>
+	void renderGains(int offset, int numSamples, bool rangeSettled, Ramp &&ramp){
+		auto &chunk = std::get<Chunk<SampleType>>(chunks);
+
+		// While the lanes are in the same state, only the first one is
+		// computed
+		const int numGains = areLanesInSync() ? 1 : numLanes;
+
+		// A settled range is the same for every chunk
+		if (rangeSettled){
+			std::fill(chunk.lows.begin(), chunk.lows.end(), (SampleType) lowSmoother.getCurrent());
+			std::fill(chunk.ranges.begin(), chunk.ranges.end(), (SampleType) highSmoother.getCurrent() - (SampleType) lowSmoother.getCurrent());
+		}
+
+		for (int lane = 0; lane < numGains; ++lane){
+			chunk.pointers[(size_t) lane] = chunk.gains[(size_t) lane].data();
+		}
+
+		// Compute the gains of every sample in a chunk, and hand them over
+		// while they are still in the cache
+		for (int done = 0; done < numSamples; done += chunkSize){
+			const int size = juce::jmin(chunkSize, numSamples - done);
+
+			const float low = lowSmoother.getCurrent();
+			const float high = highSmoother.getCurrent();
+
+			if (! rangeSettled){
+				lowSmoother.render(chunk.lows.data(), size);
+				highSmoother.render(chunk.ranges.data(), size);
+				juce::FloatVectorOperations::subtract(chunk.ranges.data(), chunk.lows.data(), size);
+			}
+
+			for (int lane = 0; lane < numGains; ++lane){
+				const auto index = (size_t) lane;
+
+				if (gainSmoothers[index].isSmoothing()){
+					// Gliding to a gain that was set from outside
+					gainSmoothers[index].render(chunk.gains[index].data(), size);
+				} else if (rangeSettled){
+					// Following the curve inside a fixed range
+					FadeCurve::render(parameters.shape, chunk.gains[index].data(), size, phases[index], steps[index], low, high);
+				} else {
+					// Following the curve inside a moving range, as
+					// low + (high - low) * curve
+					FadeCurve::render(parameters.shape, chunk.gains[index].data(), size, phases[index], steps[index], 0.0f, 1.0f);
+					juce::FloatVectorOperations::multiply(chunk.gains[index].data(), chunk.ranges.data(), size);
+					juce::FloatVectorOperations::add(chunk.gains[index].data(), chunk.lows.data(), size);
+				}
+			}
+
+			ramp(chunk.pointers.data(), numGains, chunk.lows.data(), chunk.ranges.data(), offset + done, size);
+
+			for (int lane = 0; lane < numGains; ++lane){
+				currentGains[(size_t) lane] = (float) chunk.gains[(size_t) lane][(size_t) (size - 1)];
+			}
+		}
+
+		// The lanes that were not computed follow the first one
+		if (numGains == 1){
+			for (int lane = 1; lane < numLanes; ++lane){
+				phases[(size_t) lane] = phases[0];
+				currentGains[(size_t) lane] = currentGains[0];
+				gainSmoothers[(size_t) lane] = gainSmoothers[0];
+			}
+		}
+	}
+};
@@ -0,0 +1,295 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_core/juce_core.h>
+#include "FadeCommandQueue.h"
+#include <array>
+#include <atomic>
+
+/**
+ * The fade commands and the clock shared by the instances of a fade group.
+ *
+ * A trigger in any member is broadcast to all of them with a start time on
+ * the clock of the group, at least a block ahead of the latest block any
+ * member has started, so that every member (including the ones that have
+ * already processed the current block of the host) starts it on the same
+ * sample.
+ *
+ * Triggers are written into a ring of slots claimed with a ticket counter,
+ * and every member reads them at its own pace, so neither side ever waits
+ * for another and the cost does not depend on the number of members.
+ */
+class FadeGroup {
+public:
+	/** The number of triggers kept for the members to read. */
+	static constexpr int capacity = 64;
+
+	/**
+	 * Broadcasts a command to the members, starting at a time of the clock
+	 * of the group. Called from any thread.
+	 *
+	 * The duration is in the unit chosen by every member, unless
+	 * durationInSeconds is true.
+	 */
+	void trigger(FadeCommand::Target target, double duration, juce::int64 start, bool durationInSeconds = false){
+		const auto ticket = nextTicket.fetch_add(1, std::memory_order_relaxed);
+		auto &slot = slots[(size_t) (ticket % capacity)];
+
+		// The slot is marked as being written while its fields change
+		slot.sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.target.store((int) target, std::memory_order_relaxed);
+		slot.duration.store(duration, std::memory_order_relaxed);
+		slot.durationInSeconds.store(durationInSeconds, std::memory_order_relaxed);
+		slot.start.store(start, std::memory_order_relaxed);
+		slot.sequence.store(ticket + 1, std::memory_order_release);
+	}
+
+	/**
+	 * Returns the time that a trigger from outside of the audio processing
+	 * starts at: the block after the latest one started by a member.
+	 */
+	juce::int64 getNextBlockStart() const {
+		return clock.load(std::memory_order_acquire) + blockSize.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Returns the time that a trigger from the audio processing of a member
+	 * starts at, given the time of the sample it happened at.
+	 */
+	juce::int64 getDelayedStart(juce::int64 time) const {
+		return juce::jmax(time, clock.load(std::memory_order_acquire)) + blockSize.load(std::memory_order_relaxed);
+	}
+
+private:
+	friend class FadeGroupMember;
+
+	struct Slot {
+		/** The ticket of the trigger plus one, or 0 while it is written. */
+		std::atomic<juce::uint64> sequence { 0 };
+		std::atomic<int> target { 0 };
+		std::atomic<double> duration { 0.0 };
+		std::atomic<bool> durationInSeconds { false };
+		std::atomic<juce::int64> start { 0 };
+	};
+
+	std::array<Slot, capacity> slots;
+
+	/** The ticket of the next trigger. */
+	std::atomic<juce::uint64> nextTicket { 0 };
+
+	/** The time of the latest block started by a member. */
+	std::atomic<juce::int64> clock { 0 };
+
+	/** The largest block size of the members. */
+	std::atomic<juce::int64> blockSize { 0 };
+
+	/**
+	 * Marks the start of a block of a member, at a time of the clock of the
+	 * group.
+	 */
+	void startBlock(juce::int64 time, int numSamples){
+		clock.store(time, std::memory_order_release);
+
+		auto size = blockSize.load(std::memory_order_relaxed);
+		while (size < numSamples && ! blockSize.compare_exchange_weak(size, numSamples, std::memory_order_relaxed)){}
+	}
+};
+
+/**
+ * The fade groups of the process. Every instance of the plugin that is
+ * loaded in the same process shares them.
+ */
+class FadeGroups {
+public:
+	/** The number of groups, numbered from 1. Group 0 is no group. */
+	static constexpr int numGroups = 64;
+
+	/**
+	 * Returns the group with an ID, which must be between 1 and numGroups.
+	 */
+	static FadeGroup& get(int id){
+		jassert(id >= 1 && id <= numGroups);
+		return getInstance().groups[(size_t) (id - 1)];
+	}
+
+	/**
+	 * Creates the groups, if they do not exist yet. Called once by every
+	 * instance on the message thread, so that the audio thread never does.
+	 */
+	static void initialise(){
+		getInstance();
+	}
+
+private:
+	std::array<FadeGroup, numGroups> groups;
+
+	static FadeGroups& getInstance(){
+		static FadeGroups instance;
+		return instance;
+	}
+};
+
+/**
+ * The side of a fade group that a single instance keeps. Only used by the
+ * audio thread of the instance.
+ *
+ * The clock of the group follows the timeline of the host in samples while
+ * its transport is rolling, which is the same for every instance. Otherwise
+ * every member keeps counting on from where it was, and a member that joins
+ * a group starts counting from the clock of the group.
+ */
+class FadeGroupMember {
+public:
+	/**
+	 * Moves to a group at the start of a block, or leaves any group if the
+	 * ID is 0.
+	 */
+	void setGroup(int id){
+		if (id == groupId) return;
+
+		groupId = juce::jlimit(0, FadeGroups::numGroups, id);
+		group = groupId > 0 ? &FadeGroups::get(groupId) : nullptr;
+		numPending = 0;
+
+		if (group != nullptr){
+			// Only the triggers that come after joining are followed
+			readTicket = group->nextTicket.load(std::memory_order_acquire);
+			nextTime = group->clock.load(std::memory_order_acquire);
+		}
+	}
+
+	/** Returns the group of the member, or nullptr if there is none. */
+	FadeGroup* getGroup() const {
+		return group;
+	}
+
+	/**
+	 * Returns the time of the first sample of the current block on the clock
+	 * of the group.
+	 */
+	juce::int64 getTime() const {
+		return time;
+	}
+
+	/**
+	 * Starts a block, reading the triggers of the group and calling
+	 * fire(target, duration, durationInSeconds, offset, elapsed) for the ones
+	 * that start in it, in the order they were triggered.
+	 *
+	 * A trigger read only after the sample it starts at (e.g. because it was
+	 * written while this member was processing that sample) fires at the
+	 * start of the block with the number of samples that have elapsed since,
+	 * so that the fade catches up with the other members.
+	 *
+	 * hostTime is the position of the host in samples, or negative if the
+	 * transport is stopped or does not report one.
+	 */
+	template <typename Callback>
+	void process(juce::int64 hostTime, int numSamples, Callback &&fire){
+		if (group == nullptr) return;
+
+		time = hostTime >= 0 ? hostTime : nextTime;
+		nextTime = time + numSamples;
+		group->startBlock(time, numSamples);
+
+		readTriggers();
+
+		// Triggers that were passed long ago (e.g. when the host jumped back)
+		// or lie unreasonably far ahead start right away
+		const auto blockSize = group->blockSize.load(std::memory_order_relaxed);
+		int kept = 0;
+		for (int i = 0; i < numPending; ++i){
+			const auto &trigger = pending[(size_t) i];
+			const auto offset = trigger.start - time;
+
+			if (offset < 0 && offset >= -4 * blockSize){
+				fire(trigger.target, trigger.duration, trigger.durationInSeconds, 0, -offset);
+			} else if (offset < numSamples || offset > 4 * blockSize){
+				fire(trigger.target, trigger.duration, trigger.durationInSeconds, (int) juce::jlimit<juce::int64>(0, numSamples - 1, offset), 0);
+			} else {
+				pending[(size_t) kept++] = trigger;
+			}
+		}
+		numPending = kept;
+	}
+
+private:
+	struct Trigger {
+		FadeCommand::Target target;
+		double duration;
+		bool durationInSeconds;
+		juce::int64 start;
+	};
+
+	/** The maximum number of triggers waiting for a later block. */
+	static constexpr int maxPending = 16;
+
+	int groupId = 0;
+	FadeGroup *group = nullptr;
+
+	/** The ticket of the next trigger to read. */
+	juce::uint64 readTicket = 0;
+
+	/** The time of the current block, and the one expected to follow it. */
+	juce::int64 time = 0;
+	juce::int64 nextTime = 0;
+
+	std::array<Trigger, maxPending> pending;
+	int numPending = 0;
+
+	void readTriggers(){
+		const auto lastTicket = group->nextTicket.load(std::memory_order_acquire);
+
+		// Skip the triggers that have already been overwritten
+		if (lastTicket - readTicket > (juce::uint64) FadeGroup::capacity){
+			readTicket = lastTicket - FadeGroup::capacity;
+		}
+
+		while (readTicket < lastTicket && numPending < maxPending){
+			const auto &slot = group->slots[(size_t) (readTicket % FadeGroup::capacity)];
+
+			const auto sequence = slot.sequence.load(std::memory_order_acquire);
+			Trigger trigger {
+				(FadeCommand::Target) slot.target.load(std::memory_order_relaxed),
+				slot.duration.load(std::memory_order_relaxed),
+				slot.durationInSeconds.load(std::memory_order_relaxed),
+				slot.start.load(std::memory_order_relaxed),
+			};
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			// A trigger that is still being written is read in the next
+			// block, and one that was overwritten while reading is skipped
+			if (sequence != readTicket + 1){
+				if (sequence == 0 || sequence < readTicket + 1) break;
+				++readTicket;
+				continue;
+			}
+			if (slot.sequence.load(std::memory_order_relaxed) != sequence){
+				++readTicket;
+				continue;
+			}
+
+			pending[(size_t) numPending++] = trigger;
+			++readTicket;
+		}
+	}
+};
@@ -0,0 +1,152 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <cmath>
+
+/**
+ * Applies gains to all the channels of a buffer at once, in single or double
+ * precision.
+ */
+namespace GainKernel {
+
+	/**
+	 * Returns the per-sample gains of a channel, out of the gains of
+	 * numGains lanes. The channels past the last lane share its gains.
+	 */
+	template <typename SampleType>
+	const SampleType* getChannelGains(const SampleType *const *gains, int numGains, int channel){
+		return gains[juce::jmin(channel, numGains - 1)];
+	}
+
+	/**
+	 * Multiplies every channel with the per-sample gains of its lane.
+	 */
+	template <typename SampleType>
+	void applyGains(SampleType *const *channels, int numChannels, int startSample, const SampleType *const *gains, int numGains, int numSamples){
+		for (int channel = 0; channel < numChannels; ++channel){
+			juce::FloatVectorOperations::multiply(channels[channel] + startSample, getChannelGains(gains, numGains, channel), numSamples);
+		}
+	}
+
+	/**
+	 * Multiplies every channel with a constant gain.
+	 */
+	template <typename SampleType>
+	void applyGain(SampleType *const *channels, int numChannels, int startSample, SampleType gain, int numSamples){
+		for (int channel = 0; channel < numChannels; ++channel){
+			juce::FloatVectorOperations::multiply(channels[channel] + startSample, gain, numSamples);
+		}
+	}
+
+	/**
+	 * Returns the gain of the other signal of a crossfade, from the position
+	 * of a gain inside the gain range (from low, range wide): silent at the
+	 * high gain and at full level at the low gain, following a quarter
+	 * circle in between. On a collapsed range, the other signal is silent.
+	 */
+	template <typename SampleType>
+	SampleType getCrossfadeGain(SampleType gain, SampleType low, SampleType range){
+		if (range == (SampleType) 0) return 0;
+
+		const SampleType position = juce::jlimit((SampleType) 0, (SampleType) 1, (gain - low) / range);
+		return std::sqrt((SampleType) 1 - position * position);
+	}
+
+	/**
+	 * Returns the channel of another signal to mix into a channel: the same
+	 * one, or the only one of a mono signal. Returns nullptr if there is none.
+	 */
+	template <typename SampleType>
+	const SampleType* getOtherChannel(const SampleType *const *others, int numOthers, int channel){
+		if (numOthers == 1) return others[0];
+		return channel < numOthers ? others[channel] : nullptr;
+	}
+
+	/**
+	 * Crossfades every channel with the matching channel of another signal,
+	 * in a single pass that writes the result in place: the channels are
+	 * multiplied with the per-sample gains of their lanes, and the other
+	 * signal with the complement of their positions inside the gain range,
+	 * which starts at lows and is ranges wide at each sample.
+	 */
+	template <typename SampleType>
+	void crossfade(SampleType *const *channels, int numChannels, const SampleType *const *others, int numOthers, int startSample,
+	               const SampleType *const *gains, int numGains, const SampleType *lows, const SampleType *ranges, int numSamples){
+		// The complements are computed once for all the channels of a lane,
+		// a chunk at a time
+		constexpr int chunkSize = 256;
+		SampleType otherGains[chunkSize];
+
+		for (int done = 0; done < numSamples; done += chunkSize){
+			const int size = juce::jmin(chunkSize, numSamples - done);
+			const SampleType *complemented = nullptr;
+
+			for (int channel = 0; channel < numChannels; ++channel){
+				const SampleType *chunkGains = getChannelGains(gains, numGains, channel) + done;
+				SampleType *data = channels[channel] + startSample + done;
+				const SampleType *other = getOtherChannel(others, numOthers, channel);
+
+				if (other == nullptr){
+					juce::FloatVectorOperations::multiply(data, chunkGains, size);
+					continue;
+				}
+
+				if (chunkGains != complemented){
+					for (int i = 0; i < size; ++i){
+						otherGains[i] = getCrossfadeGain(chunkGains[i], lows[done + i], ranges[done + i]);
+					}
+					complemented = chunkGains;
+				}
+
+				other += startSample + done;
+				for (int i = 0; i < size; ++i){
+					data[i] = data[i] * chunkGains[i] + other[i] * otherGains[i];
+				}
+			}
+		}
+	}
+
+	/**
+	 * Crossfades every channel with another signal at the constant gain of
+	 * its lane.
+	 */
+	template <typename SampleType>
+	void crossfade(SampleType *const *channels, int numChannels, const SampleType *const *others, int numOthers, int startSample,
+	               const float *gains, int numGains, SampleType low, SampleType range, int numSamples){
+		for (int channel = 0; channel < numChannels; ++channel){
+			const SampleType gain = gains[juce::jmin(channel, numGains - 1)];
+			const SampleType otherGain = getCrossfadeGain(gain, low, range);
+			SampleType *data = channels[channel] + startSample;
+			const SampleType *other = getOtherChannel(others, numOthers, channel);
+
+			if (other == nullptr){
+				juce::FloatVectorOperations::multiply(data, gain, numSamples);
+				continue;
+			}
+
+			other += startSample;
+			for (int i = 0; i < numSamples; ++i){
+				data[i] = data[i] * gain + other[i] * otherGain;
+			}
+		}
+	}
+}
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include <cstring>
+
+/**
+ * Passes the latest state of the fader from the audio thread to the other
+ * threads.
+ *
+ * The whole state is packed in a single atomic, so readers always see a
+ * consistent snapshot and the audio thread never blocks.
+ */
+class GainTelemetry {
+public:
+	struct Snapshot {
+		/** The current value of the gain. */
+		float gain = 1.0f;
+
+		/**
+		 * The direction of the fading, with the same meaning as the
+		 * "fading" parameter.
+		 */
+		float fading = 1.0f;
+
+		bool operator==(const Snapshot &other) const {
+			return gain == other.gain && fading == other.fading;
+		}
+
+		bool operator!=(const Snapshot &other) const {
+			return ! (*this == other);
+		}
+	};
+
+	/**
+	 * Publishes a new snapshot. Called from the audio thread.
+	 */
+	void publish(const Snapshot &snapshot){
+		packed.store(pack(snapshot), std::memory_order_release);
+	}
+
+	/**
+	 * Returns the latest published snapshot.
+	 */
+	Snapshot read() const {
+		return unpack(packed.load(std::memory_order_acquire));
+	}
+
+private:
+	static_assert(sizeof(Snapshot) == sizeof(juce::uint64), "The snapshot must fit in a single atomic");
+
+	std::atomic<juce::uint64> packed { pack({}) };
+
+	static juce::uint64 pack(const Snapshot &snapshot){
+		juce::uint64 bits;
+		std::memcpy(&bits, &snapshot, sizeof(bits));
+		return bits;
+	}
+
+	static Snapshot unpack(juce::uint64 bits){
+		Snapshot snapshot;
+		std::memcpy(static_cast<void*>(&snapshot), &bits, sizeof(bits));
+		return snapshot;
+	}
+};
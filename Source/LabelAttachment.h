@@ -24,11 +24,16 @@
 
 /**
  * Attaches a label to display (and possibly edit) the value of a parameter.
+ *
+ * The label is not updated on every change of the parameter, but pulls its
+ * value once per frame of the display, and is only given new text when the
+ * text would change.
  */
 class LabelAttachment : private juce::Label::Listener {
 public:
 	LabelAttachment(juce::Label &label, juce::RangedAudioParameter &param)
-	: label(label), attachment(param, [this](float v){ this->setLabel(v); })
+	: label(label), param(param), attachment(param, [](float){}),
+	  vBlankAttachment(&label, [this](){ this->update(); })
 	{
 		label.addListener(this);
 	}
@@ -40,14 +45,27 @@ public:
 private:
 	juce::Label &label;
 
+	juce::RangedAudioParameter &param;
+
 	juce::ParameterAttachment attachment;
 
-	void setLabel(float value){
-		label.setText(juce::String(value), juce::dontSendNotification);
+	juce::VBlankAttachment vBlankAttachment;
+
+	/** The value the text of the label was last formatted from. */
+	float displayedValue = std::numeric_limits<float>::quiet_NaN();
+
+	void update(){
+		const float value = param.convertFrom0to1(param.getValue());
+		if (value == displayedValue || label.isBeingEdited()) return;
+
+		displayedValue = value;
+
+		// Label::setText() only repaints if the text is different
+		label.setText(juce::String(value, 2), juce::dontSendNotification);
 	}
 
 	void labelTextChanged(juce::Label *label) override {
 		float value = label->getText().getFloatValue();
 		attachment.setValueAsCompleteGesture(value);
 	}
-};
\ No newline at end of file
+};
@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_core/juce_core.h>
+#include <array>
+#include <cmath>
+
+/**
+ * Measures the peak and RMS levels of the audio before and after the gain.
+ *
+ * The kernels apply the gain and measure both levels in a single pass over
+ * each channel. They keep a separate accumulator for each of a few
+ * consecutive samples, so that the compiler can turn the loops into SIMD
+ * code without changing the order of the floating point operations.
+ */
+namespace LevelMeter {
+
+	/** The number of samples the kernels process side by side. */
+	constexpr int lanes = 8;
+
+	/**
+	 * The levels of a block, summed over all of its channels.
+	 */
+	struct Levels {
+		/** The highest absolute sample value. */
+		float peak = 0.0f;
+
+		/** The sum of the squares of the samples. */
+		double sumOfSquares = 0.0;
+
+		/** The number of samples measured, in all channels. */
+		juce::int64 numSamples = 0;
+
+		/** Adds the levels of other samples. */
+		void add(const Levels &other){
+			peak = juce::jmax(peak, other.peak);
+			sumOfSquares += other.sumOfSquares;
+			numSamples += other.numSamples;
+		}
+
+		/** Returns the RMS level of the samples measured. */
+		float getRms() const {
+			return numSamples > 0 ? (float) std::sqrt(sumOfSquares / (double) numSamples) : 0.0f;
+		}
+	};
+
+	/**
+	 * The levels of a block, as handed to the editor.
+	 */
+	struct Reading {
+		float inputPeak = 0.0f;
+		float inputRms = 0.0f;
+		float outputPeak = 0.0f;
+		float outputRms = 0.0f;
+	};
+
+	/**
+	 * Adds the levels measured by one kernel to the levels of the block.
+	 */
+	template <typename SampleType>
+	void accumulate(Levels &levels, const SampleType (&peaks)[lanes], const SampleType (&sums)[lanes], int numSamples){
+		for (int lane = 0; lane < lanes; ++lane){
+			levels.peak = juce::jmax(levels.peak, (float) peaks[lane]);
+			levels.sumOfSquares += (double) sums[lane];
+		}
+		levels.numSamples += numSamples;
+	}
+
+	/**
+	 * Multiplies a channel with the gains given by gainAt(index), measuring
+	 * the levels before and after.
+	 */
+	template <typename SampleType, typename GainFunction>
+	void applyAndMeasure(SampleType *data, int numSamples, GainFunction gainAt, Levels &input, Levels &output){
+		SampleType inputPeaks[lanes] = {}, inputSums[lanes] = {};
+		SampleType outputPeaks[lanes] = {}, outputSums[lanes] = {};
+
+		int index = 0;
+		for (; index + lanes <= numSamples; index += lanes){
+			// Each step is its own loop over the lanes, working on local
+			// copies of the samples, which GCC and Clang vectorise more
+			// reliably than a single loop that reads and writes data
+			SampleType in[lanes], out[lanes];
+			for (int lane = 0; lane < lanes; ++lane) in[lane] = data[index + lane];
+			for (int lane = 0; lane < lanes; ++lane) out[lane] = in[lane] * gainAt(index + lane);
+
+			for (int lane = 0; lane < lanes; ++lane){
+				const SampleType magnitude = std::abs(in[lane]);
+				inputPeaks[lane] = inputPeaks[lane] < magnitude ? magnitude : inputPeaks[lane];
+			}
+			for (int lane = 0; lane < lanes; ++lane){
+				const SampleType magnitude = std::abs(out[lane]);
+				outputPeaks[lane] = outputPeaks[lane] < magnitude ? magnitude : outputPeaks[lane];
+			}
+			for (int lane = 0; lane < lanes; ++lane){
+				inputSums[lane] += in[lane] * in[lane];
+				outputSums[lane] += out[lane] * out[lane];
+			}
+
+			for (int lane = 0; lane < lanes; ++lane) data[index + lane] = out[lane];
+		}
+
+		// The samples left over go into the first lane
+		for (; index < numSamples; ++index){
+			const SampleType in = data[index];
+			const SampleType out = in * gainAt(index);
+
+			inputPeaks[0] = juce::jmax(inputPeaks[0], std::abs(in));
+			inputSums[0] += in * in;
+			outputPeaks[0] = juce::jmax(outputPeaks[0], std::abs(out));
+			outputSums[0] += out * out;
+
+			data[index] = out;
+		}
+
+		accumulate(input, inputPeaks, inputSums, numSamples);
+		accumulate(output, outputPeaks, outputSums, numSamples);
+	}
+
+	/**
+	 * Measures the levels of a channel without changing it.
+	 */
+	template <typename SampleType>
+	void measure(const SampleType *data, int numSamples, Levels &levels){
+		SampleType peaks[lanes] = {}, sums[lanes] = {};
+
+		int index = 0;
+		for (; index + lanes <= numSamples; index += lanes){
+			SampleType samples[lanes];
+			for (int lane = 0; lane < lanes; ++lane) samples[lane] = data[index + lane];
+
+			for (int lane = 0; lane < lanes; ++lane){
+				const SampleType magnitude = std::abs(samples[lane]);
+				peaks[lane] = peaks[lane] < magnitude ? magnitude : peaks[lane];
+			}
+			for (int lane = 0; lane < lanes; ++lane){
+				sums[lane] += samples[lane] * samples[lane];
+			}
+		}
+
+		for (; index < numSamples; ++index){
+			peaks[0] = juce::jmax(peaks[0], std::abs(data[index]));
+			sums[0] += data[index] * data[index];
+		}
+
+		accumulate(levels, peaks, sums, numSamples);
+	}
+
+	/**
+	 * Multiplies every channel with the per-sample gains of its lane (the
+	 * last one for the channels past it), measuring the levels before and
+	 * after.
+	 */
+	template <typename SampleType>
+	void applyGains(SampleType *const *channels, int numChannels, int startSample, const SampleType *const *laneGains, int numGains, int numSamples, Levels &input, Levels &output){
+		for (int channel = 0; channel < numChannels; ++channel){
+			const SampleType *gains = laneGains[juce::jmin(channel, numGains - 1)];
+			applyAndMeasure(channels[channel] + startSample, numSamples, [gains](int index){ return gains[index]; }, input, output);
+		}
+	}
+
+	/**
+	 * Multiplies every channel with a constant gain, measuring the levels
+	 * before and after.
+	 */
+	template <typename SampleType>
+	void applyGain(SampleType *const *channels, int numChannels, int startSample, SampleType gain, int numSamples, Levels &input, Levels &output){
+		for (int channel = 0; channel < numChannels; ++channel){
+			applyAndMeasure(channels[channel] + startSample, numSamples, [gain](int){ return gain; }, input, output);
+		}
+	}
+
+	/**
+	 * A wait-free queue of readings, from the audio thread to the editor.
+	 *
+	 * When the editor falls behind, the newest readings are dropped, which
+	 * only delays the meters.
+	 */
+	class Queue {
+	public:
+		/**
+		 * Adds a reading. Called from the audio thread.
+		 */
+		void push(const Reading &reading){
+			int start1, size1, start2, size2;
+			fifo.prepareToWrite(1, start1, size1, start2, size2);
+			if (size1 + size2 == 0) return;
+
+			readings[(size_t) (size1 > 0 ? start1 : start2)] = reading;
+			fifo.finishedWrite(1);
+		}
+
+		/**
+		 * Removes all the readings and combines them into one, with the
+		 * highest peaks and the latest RMS levels.
+		 *
+		 * Returns false if there were none.
+		 */
+		bool pop(Reading &combined){
+			const int numReady = fifo.getNumReady();
+			if (numReady == 0) return false;
+
+			combined = {};
+			int start1, size1, start2, size2;
+			fifo.prepareToRead(numReady, start1, size1, start2, size2);
+
+			const auto combine = [&](int start, int size){
+				for (int i = start; i < start + size; ++i){
+					const auto &reading = readings[(size_t) i];
+					combined.inputPeak = juce::jmax(combined.inputPeak, reading.inputPeak);
+					combined.outputPeak = juce::jmax(combined.outputPeak, reading.outputPeak);
+					combined.inputRms = reading.inputRms;
+					combined.outputRms = reading.outputRms;
+				}
+			};
+			combine(start1, size1);
+			combine(start2, size2);
+			fifo.finishedRead(size1 + size2);
+
+			return true;
+		}
+
+	private:
+		static constexpr int capacity = 128;
+
+		juce::AbstractFifo fifo { capacity };
+		std::array<Reading, capacity> readings;
+	};
+}
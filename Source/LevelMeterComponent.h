@@ -0,0 +1,111 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_gui_basics/juce_gui_basics.h>
+#include "LevelMeter.h"
+#include <cmath>
+
+/**
+ * Two horizontal bars that show the levels of the input (top) and the
+ * output (bottom), with the RMS level filled and the peak level as a line.
+ *
+ * The levels are given once per frame of the display. They rise at once and
+ * fall back at a fixed rate, so that short peaks stay visible.
+ */
+class LevelMeterComponent : public juce::Component {
+public:
+	/**
+	 * Moves the bars to a new reading, or lets them fall if there is none.
+	 */
+	void update(const LevelMeter::Reading *reading){
+		const double now = juce::Time::getMillisecondCounterHiRes();
+		const double elapsed = lastUpdate > 0.0 ? (now - lastUpdate) * 0.001 : 0.0;
+		lastUpdate = now;
+
+		const float decay = (float) std::pow(10.0, -fallRate * elapsed / 20.0);
+
+		LevelMeter::Reading next {
+			shown.inputPeak * decay, shown.inputRms * decay,
+			shown.outputPeak * decay, shown.outputRms * decay,
+		};
+		if (reading != nullptr){
+			next.inputPeak = juce::jmax(next.inputPeak, reading->inputPeak);
+			next.inputRms = juce::jmax(next.inputRms, reading->inputRms);
+			next.outputPeak = juce::jmax(next.outputPeak, reading->outputPeak);
+			next.outputRms = juce::jmax(next.outputRms, reading->outputRms);
+		}
+
+		// Only repaint when a bar moves by at least a pixel
+		const auto moved = [this](float a, float b){
+			return std::abs(toX(a) - toX(b)) >= 1.0f;
+		};
+		if (moved(next.inputPeak, shown.inputPeak) || moved(next.inputRms, shown.inputRms)
+		 || moved(next.outputPeak, shown.outputPeak) || moved(next.outputRms, shown.outputRms)){
+			repaint();
+		}
+
+		shown = next;
+	}
+
+	void paint(juce::Graphics &g) override {
+		const auto bounds = getLocalBounds().toFloat();
+		const float barHeight = (bounds.getHeight() - gap) / 2.0f;
+
+		paintBar(g, bounds.withHeight(barHeight), shown.inputPeak, shown.inputRms);
+		paintBar(g, bounds.withTrimmedTop(barHeight + gap), shown.outputPeak, shown.outputRms);
+	}
+
+private:
+	/** How fast the bars fall, in dB per second. */
+	static constexpr double fallRate = 24.0;
+
+	/** The lowest level shown, in dB. */
+	static constexpr float minDecibels = -60.0f;
+
+	/** The space between the bars, in pixels. */
+	static constexpr float gap = 2.0f;
+
+	/** The levels being shown, which have already fallen. */
+	LevelMeter::Reading shown;
+
+	/** When update() was last called, in milliseconds. */
+	double lastUpdate = 0.0;
+
+	/**
+	 * Returns the position of a level along the bars, on a dB scale.
+	 */
+	float toX(float level) const {
+		const float decibels = juce::Decibels::gainToDecibels(level, minDecibels);
+		return juce::jmap(decibels, minDecibels, 0.0f, 0.0f, (float) getWidth());
+	}
+
+	void paintBar(juce::Graphics &g, juce::Rectangle<float> bar, float peak, float rms){
+		g.setColour(findColour(juce::Slider::backgroundColourId));
+		g.fillRect(bar);
+
+		g.setColour(findColour(juce::Slider::trackColourId));
+		g.fillRect(bar.withWidth(juce::jmin(bar.getWidth(), toX(rms))));
+
+		// Levels above 0 dB are clipped to the end, and shown in red
+		g.setColour(peak > 1.0f ? juce::Colours::red : findColour(juce::Slider::thumbColourId));
+		g.fillRect(bar.withX(juce::jlimit(0.0f, bar.getWidth() - 2.0f, toX(peak) - 1.0f)).withWidth(2.0f));
+	}
+};
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "FadeCommandQueue.h"
+#include <array>
+
+/**
+ * A MIDI message that can trigger a fade.
+ */
+struct MidiTrigger {
+	enum Kind {
+		/** Does not match any message. */
+		None,
+		/** A note on message, with any velocity. */
+		Note,
+		/** A controller message with a value of 64 or more. */
+		Controller,
+		/** A program change message. */
+		Program,
+	};
+
+	Kind kind = None;
+
+	/** The MIDI channel, from 1 to 16. */
+	int channel = 1;
+
+	/** The note, controller or program number. */
+	int number = 0;
+
+	/**
+	 * Finds the trigger a message corresponds to, or a trigger of kind None
+	 * if the message cannot trigger anything.
+	 */
+	static MidiTrigger fromMessage(const juce::MidiMessage &message){
+		if (message.isNoteOn()){
+			return { Note, message.getChannel(), message.getNoteNumber() };
+		} else if (message.isController() && message.getControllerValue() >= 64){
+			return { Controller, message.getChannel(), message.getControllerNumber() };
+		} else if (message.isProgramChange()){
+			return { Program, message.getChannel(), message.getProgramChangeNumber() };
+		}
+
+		return {};
+	}
+
+	/**
+	 * Packs the trigger in 13 bits, with 0 meaning kind None.
+	 */
+	juce::uint32 pack() const {
+		if (kind == None) return 0;
+		return (juce::uint32) kind
+		     | (juce::uint32) (channel - 1) << 2
+		     | (juce::uint32) number << 6;
+	}
+
+	static MidiTrigger unpack(juce::uint32 bits){
+		MidiTrigger trigger;
+		trigger.kind = (Kind) (bits & 0x3);
+		trigger.channel = (int) ((bits >> 2) & 0xf) + 1;
+		trigger.number = (int) ((bits >> 6) & 0x7f);
+		return trigger;
+	}
+
+	bool operator==(const MidiTrigger &other) const {
+		return pack() == other.pack();
+	}
+
+	/**
+	 * Returns a short description of the trigger, to be shown to the user.
+	 */
+	juce::String getDescription() const {
+		const auto suffix = " (ch " + juce::String(channel) + ")";
+
+		switch (kind){
+			case None: return {};
+			case Note: return "Note " + juce::MidiMessage::getMidiNoteName(number, true, true, 3) + suffix;
+			case Controller: return "CC " + juce::String(number) + suffix;
+			case Program: return "Program " + juce::String(number + 1) + suffix;
+		}
+
+		return {};
+	}
+};
+
+/**
+ * A fade that is triggered by a MIDI message.
+ */
+struct MidiMapping {
+	MidiTrigger trigger;
+
+	/** The kind of fade to trigger. */
+	FadeCommand::Target action = FadeCommand::Toggle;
+
+	/** The duration of the fade, in the unit of FadeCommand::duration. */
+	double duration = 1.0;
+
+	/** Returns true if the mapping is in use. */
+	bool isActive() const {
+		return trigger.kind != MidiTrigger::None;
+	}
+};
+
+/**
+ * A fixed set of MIDI mappings that can be changed from the message thread
+ * while the audio thread reads them.
+ *
+ * Every mapping is packed in a single atomic, so the audio thread always sees
+ * a whole mapping without locking.
+ */
+class MidiMappings {
+public:
+	static constexpr int size = 16;
+
+	/**
+	 * Returns the mapping in a slot.
+	 */
+	MidiMapping get(int slot) const {
+		return unpack(slots[(size_t) slot].load(std::memory_order_acquire));
+	}
+
+	/**
+	 * Changes the mapping in a slot.
+	 */
+	void set(int slot, const MidiMapping &mapping){
+		slots[(size_t) slot].store(pack(mapping), std::memory_order_release);
+	}
+
+	/**
+	 * Empties a slot.
+	 */
+	void clear(int slot){
+		slots[(size_t) slot].store(0, std::memory_order_release);
+	}
+
+	/**
+	 * Finds the first mapping that is triggered by a trigger.
+	 *
+	 * Returns false if no mapping matches.
+	 */
+	bool find(const MidiTrigger &trigger, MidiMapping &mapping) const {
+		const auto packedTrigger = (juce::uint64) trigger.pack();
+		if (packedTrigger == 0) return false;
+
+		for (const auto &slot : slots){
+			const auto bits = slot.load(std::memory_order_acquire);
+			if ((bits & triggerMask) == packedTrigger){
+				mapping = unpack(bits);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+private:
+	/*
+	 * A mapping is packed with the trigger in the low 13 bits, the action in
+	 * the next 2 bits and the duration in milliseconds in the high 32 bits.
+	 */
+	static constexpr juce::uint64 triggerMask = 0x1fff;
+
+	std::array<std::atomic<juce::uint64>, size> slots {};
+
+	static juce::uint64 pack(const MidiMapping &mapping){
+		if (! mapping.isActive()) return 0;
+
+		const auto milliseconds = (juce::uint32) juce::jlimit(0.0, 4294967295.0, std::round(mapping.duration * 1000.0));
+		return (juce::uint64) mapping.trigger.pack()
+		     | (juce::uint64) mapping.action << 13
+		     | (juce::uint64) milliseconds << 32;
+	}
+
+	static MidiMapping unpack(juce::uint64 bits){
+		MidiMapping mapping;
+		mapping.trigger = MidiTrigger::unpack((juce::uint32) (bits & triggerMask));
+		mapping.action = (FadeCommand::Target) ((bits >> 13) & 0x3);
+		mapping.duration = (double) (bits >> 32) / 1000.0;
+		return mapping;
+	}
+};
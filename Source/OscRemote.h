@@ -0,0 +1,423 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_core/juce_core.h>
+#include "FadeCommandQueue.h"
+#include "FadeGroups.h"
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+
+/**
+ * A request received from a remote controller, on its way to the audio
+ * thread.
+ */
+struct RemoteCommand {
+	enum Kind {
+		/** Start a fade, like FadeCommand. */
+		Fade,
+		/** Set the gain range. */
+		Range,
+	};
+
+	Kind kind = Fade;
+
+	FadeCommand::Target target = FadeCommand::Toggle;
+
+	/**
+	 * The duration of the fade, in the unit of FadeCommand::duration, or NaN
+	 * to use the fade time set in the editor.
+	 */
+	double duration = std::numeric_limits<double>::quiet_NaN();
+
+	/** The fade group to fade, or 0 for the instance that received it. */
+	int group = 0;
+
+	/** The channels to fade, as in FadeCommand::channels. */
+	juce::uint32 channels = 0;
+
+	/** The new gain range. */
+	float low = 0.0f;
+	float high = 1.0f;
+
+	/** When the message was received, in high resolution ticks. */
+	juce::int64 receivedTicks = 0;
+};
+
+/**
+ * A wait-free queue of remote commands, from the thread that receives them
+ * to the audio thread.
+ */
+class RemoteCommandQueue {
+public:
+	/**
+	 * Adds a command. Returns false, dropping it, if the queue is full.
+	 */
+	bool push(const RemoteCommand &command){
+		int start1, size1, start2, size2;
+		fifo.prepareToWrite(1, start1, size1, start2, size2);
+		if (size1 + size2 == 0) return false;
+
+		commands[(size_t) (size1 > 0 ? start1 : start2)] = command;
+		fifo.finishedWrite(1);
+		return true;
+	}
+
+	/**
+	 * Removes the command at the front of the queue. Returns false if the
+	 * queue is empty.
+	 */
+	bool pop(RemoteCommand &command){
+		int start1, size1, start2, size2;
+		fifo.prepareToRead(1, start1, size1, start2, size2);
+		if (size1 + size2 == 0) return false;
+
+		command = commands[(size_t) (size1 > 0 ? start1 : start2)];
+		fifo.finishedRead(1);
+		return true;
+	}
+
+private:
+	static constexpr int capacity = 64;
+
+	juce::AbstractFifo fifo { capacity };
+
+	std::array<RemoteCommand, capacity> commands;
+};
+
+/**
+ * Statistics of the time between receiving a remote command and the audio
+ * thread picking it up. Written by the audio thread, read by any thread.
+ */
+class RemoteLatency {
+public:
+	struct Stats {
+		juce::int64 count = 0;
+		/** In milliseconds. */
+		double last = 0.0;
+		double average = 0.0;
+		double max = 0.0;
+	};
+
+	void record(double milliseconds){
+		count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		total.store(total.load(std::memory_order_relaxed) + milliseconds, std::memory_order_relaxed);
+		last.store(milliseconds, std::memory_order_relaxed);
+		if (milliseconds > max.load(std::memory_order_relaxed)) max.store(milliseconds, std::memory_order_relaxed);
+	}
+
+	Stats getStats() const {
+		Stats stats;
+		stats.count = count.load(std::memory_order_relaxed);
+		stats.last = last.load(std::memory_order_relaxed);
+		stats.max = max.load(std::memory_order_relaxed);
+		stats.average = stats.count > 0 ? total.load(std::memory_order_relaxed) / stats.count : 0.0;
+		return stats;
+	}
+
+private:
+	std::atomic<juce::int64> count { 0 };
+	std::atomic<double> total { 0.0 };
+	std::atomic<double> last { 0.0 };
+	std::atomic<double> max { 0.0 };
+};
+
+/**
+ * Receives OSC messages over UDP on the loopback interface, and hands the
+ * ones it understands to the audio thread through a RemoteCommandQueue.
+ *
+ * The messages are, with the durations in seconds:
+ *
+ *   /fade [duration] [channels]       Fade towards the opposite end of the range.
+ *   /fadeDown [duration] [channels]   Fade towards the low gain.
+ *   /fadeUp [duration] [channels]     Fade towards the high gain.
+ *   /stop [channels]                  Hold the gain where it is.
+ *   /range <low> <high>               Set the gain range.
+ *
+ * Without a duration, the fade times set in the editor are used. The
+ * channels are a mask with a bit per channel, and all of them are faded
+ * without one. The fades under /fader/<group> (e.g. /fader/2/fadeUp) fade
+ * every channel of every member of a fade group, so they are ignored with a
+ * mask, and /fader/0 is the same as no prefix. The arguments can be
+ * floats, doubles or integers, and bundles are unpacked.
+ *
+ * Packets are read into a fixed buffer and parsed in place, so nothing is
+ * allocated per message.
+ */
+class OscRemote : private juce::Thread {
+public:
+	explicit OscRemote(RemoteCommandQueue &queue) : juce::Thread("FaderVST OSC"), queue(queue) {}
+
+	~OscRemote() override {
+		stop();
+	}
+
+	/**
+	 * Starts listening on a port of the loopback interface, or stops if the
+	 * port is 0. Returns false if the port cannot be used.
+	 */
+	bool listen(int newPort){
+		stop();
+		if (newPort <= 0) return true;
+
+		socket = std::make_unique<juce::DatagramSocket>(false);
+		if (! socket->bindToPort(newPort, "127.0.0.1")){
+			socket.reset();
+			return false;
+		}
+
+		port = newPort;
+		startThread();
+		return true;
+	}
+
+	/** Stops listening. */
+	void stop(){
+		signalThreadShouldExit();
+		if (socket != nullptr) socket->shutdown();
+		stopThread(1000);
+		socket.reset();
+		port = 0;
+	}
+
+	/** Returns the port being listened on, or 0 if there is none. */
+	int getPort() const {
+		return port;
+	}
+
+	/** Returns the number of commands dropped because the queue was full. */
+	int getNumDropped() const {
+		return numDropped;
+	}
+
+	/**
+	 * Parses an OSC packet, calling handle(command) for every message in it
+	 * that is understood.
+	 */
+	template <typename Callback>
+	static void parsePacket(const char *data, int size, Callback &&handle){
+		// A bundle holds a time tag and then elements, each prefixed with
+		// its size
+		if (size >= 16 && std::memcmp(data, "#bundle", 8) == 0){
+			int position = 16;
+			while (position + 4 <= size){
+				const int elementSize = (int) readInt(data + position);
+				position += 4;
+				if (elementSize <= 0 || elementSize > size - position) return;
+
+				parsePacket(data + position, elementSize, handle);
+				position += elementSize;
+			}
+			return;
+		}
+
+		RemoteCommand command;
+		if (parseMessage(data, size, command)){
+			handle(command);
+		}
+	}
+
+	/**
+	 * Writes an OSC message with float arguments into a buffer, returning
+	 * its size, or 0 if it does not fit. Used by test clients.
+	 */
+	static int writeMessage(char *data, int maxSize, const char *address, std::initializer_list<float> arguments){
+		int position = 0;
+		const auto append = [&](const void *bytes, int numBytes){
+			if (position + numBytes > maxSize) return false;
+			std::memcpy(data + position, bytes, (size_t) numBytes);
+			position += numBytes;
+			return true;
+		};
+		const auto appendString = [&](const char *text){
+			const int length = (int) std::strlen(text);
+			const int padded = (length / 4 + 1) * 4;
+			if (position + padded > maxSize) return false;
+			std::memset(data + position, 0, (size_t) padded);
+			std::memcpy(data + position, text, (size_t) length);
+			position += padded;
+			return true;
+		};
+
+		char tags[16] = ",";
+		int numTags = 1;
+		for (size_t i = 0; i < arguments.size() && numTags < 15; ++i){
+			tags[numTags++] = 'f';
+		}
+		tags[numTags] = 0;
+
+		if (! appendString(address) || ! appendString(tags)) return 0;
+
+		for (const float argument : arguments){
+			juce::uint32 bits;
+			std::memcpy(&bits, &argument, 4);
+			const auto bigEndian = juce::ByteOrder::swapIfLittleEndian(bits);
+			if (! append(&bigEndian, 4)) return 0;
+		}
+
+		return position;
+	}
+
+private:
+	RemoteCommandQueue &queue;
+
+	std::unique_ptr<juce::DatagramSocket> socket;
+	std::atomic<int> port { 0 };
+	std::atomic<int> numDropped { 0 };
+
+	/** The largest packet that is read, which is more than any message needs. */
+	std::array<char, 1536> buffer;
+
+	void run() override {
+		while (! threadShouldExit()){
+			if (socket->waitUntilReady(true, 100) != 1) continue;
+
+			const int size = socket->read(buffer.data(), (int) buffer.size(), false);
+			if (size <= 0) continue;
+
+			const auto ticks = juce::Time::getHighResolutionTicks();
+			parsePacket(buffer.data(), size, [this, ticks](RemoteCommand command){
+				command.receivedTicks = ticks;
+				if (! queue.push(command)) ++numDropped;
+			});
+		}
+	}
+
+	static juce::uint32 readInt(const char *data){
+		juce::uint32 value;
+		std::memcpy(&value, data, 4);
+		return juce::ByteOrder::swapIfLittleEndian(value);
+	}
+
+	/**
+	 * Returns the length of a padded OSC string, or -1 if it is not
+	 * terminated inside the packet.
+	 */
+	static int getPaddedLength(const char *data, int size){
+		for (int i = 0; i < size; ++i){
+			if (data[i] == 0) return juce::jmin(size, (i / 4 + 1) * 4);
+		}
+		return -1;
+	}
+
+	/** Converts an argument to a mask of channels. */
+	static juce::uint32 toChannels(double argument){
+		return (juce::uint32) juce::jlimit(0.0, 65535.0, argument);
+	}
+
+	static bool parseMessage(const char *data, int size, RemoteCommand &command){
+		const int addressLength = getPaddedLength(data, size);
+		if (addressLength < 0 || data[0] != '/') return false;
+
+		// Read up to two numeric arguments
+		double arguments[2] = {};
+		int numArguments = 0;
+
+		const char *tags = data + addressLength;
+		const int tagsLength = getPaddedLength(tags, size - addressLength);
+		int position = addressLength + juce::jmax(0, tagsLength);
+
+		if (tagsLength > 0 && tags[0] == ','){
+			for (const char *tag = tags + 1; *tag != 0; ++tag){
+				double value;
+				if (*tag == 'f' && position + 4 <= size){
+					const auto bits = readInt(data + position);
+					float floatValue;
+					std::memcpy(&floatValue, &bits, 4);
+					value = floatValue;
+					position += 4;
+				} else if (*tag == 'i' && position + 4 <= size){
+					value = (double) (juce::int32) readInt(data + position);
+					position += 4;
+				} else if (*tag == 'd' && position + 8 <= size){
+					const juce::uint64 bits = ((juce::uint64) readInt(data + position) << 32) | readInt(data + position + 4);
+					std::memcpy(&value, &bits, 8);
+					position += 8;
+				} else {
+					return false;
+				}
+
+				if (numArguments < 2) arguments[numArguments++] = value;
+			}
+		}
+
+		// Split off the /fader/<group> prefix
+		const char *method = data;
+		if (std::strncmp(data, "/fader/", 7) == 0){
+			const char *digits = data + 7;
+			int group = 0;
+			int numDigits = 0;
+			while (digits[numDigits] >= '0' && digits[numDigits] <= '9' && numDigits < 3){
+				group = group * 10 + (digits[numDigits] - '0');
+				++numDigits;
+			}
+			if (numDigits == 0 || digits[numDigits] != '/' || group > FadeGroups::numGroups) return false;
+
+			command.group = group;
+			method = digits + numDigits;
+		}
+
+		if (std::strcmp(method, "/range") == 0){
+			if (numArguments < 2 || command.group != 0) return false;
+			command.kind = RemoteCommand::Range;
+			command.low = (float) juce::jlimit(0.0, 1.0, arguments[0]);
+			command.high = (float) juce::jlimit(0.0, 1.0, arguments[1]);
+			return true;
+		}
+
+		if (std::strcmp(method, "/fade") == 0){
+			command.target = FadeCommand::Toggle;
+		} else if (std::strcmp(method, "/fadeDown") == 0){
+			command.target = FadeCommand::Down;
+		} else if (std::strcmp(method, "/fadeUp") == 0){
+			command.target = FadeCommand::Up;
+		} else if (std::strcmp(method, "/stop") == 0){
+			command.target = FadeCommand::Stop;
+			command.duration = 0.0;
+			if (numArguments > 0){
+				command.channels = toChannels(arguments[0]);
+			}
+			return isValidForGroup(command);
+		} else {
+			return false;
+		}
+
+		if (numArguments > 0){
+			command.duration = juce::jmax(0.0, arguments[0]);
+		}
+		if (numArguments > 1){
+			command.channels = toChannels(arguments[1]);
+		}
+		return isValidForGroup(command);
+	}
+
+	/**
+	 * Returns false for a fade of some of the channels of a fade group,
+	 * which fade groups cannot broadcast.
+	 */
+	static bool isValidForGroup(const RemoteCommand &command){
+		return command.group == 0 || command.channels == 0;
+	}
+};
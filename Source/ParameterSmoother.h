@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_core/juce_core.h>
+
+/**
+ * Moves a value linearly towards a target over a fixed number of samples.
+ *
+ * Unlike juce::SmoothedValue, the values of a whole run of samples are
+ * rendered at once, and each one is computed from its distance to the start
+ * of the ramp rather than by accumulating steps, so the loop can be
+ * vectorised and the result does not depend on how the ramp is split into
+ * blocks.
+ */
+class ParameterSmoother {
+public:
+	/**
+	 * Jumps to a value, stopping any ramp in progress.
+	 */
+	void reset(float value){
+		start = target = current = value;
+		position = length = 0;
+	}
+
+	/**
+	 * Starts a ramp from the current value to a new target, lasting for the
+	 * given number of samples.
+	 *
+	 * Does nothing if the target has not changed.
+	 */
+	void setTarget(float newTarget, int rampLength){
+		if (newTarget == target) return;
+
+		start = current;
+		target = newTarget;
+		position = 0;
+		length = juce::jmax(0, rampLength);
+
+		if (length == 0) current = target;
+	}
+
+	/** Returns true while a ramp is in progress. */
+	bool isSmoothing() const {
+		return position < length;
+	}
+
+	/** Returns the number of samples left until the ramp reaches the target. */
+	int getRemaining() const {
+		return length - position;
+	}
+
+	/** Returns the value reached by the ramp so far. */
+	float getCurrent() const {
+		return current;
+	}
+
+	/** Returns the value the ramp is moving towards. */
+	float getTarget() const {
+		return target;
+	}
+
+	/**
+	 * Returns true if another smoother renders the same values, being at the
+	 * same point of the same ramp or not moving at all.
+	 */
+	bool isInStepWith(const ParameterSmoother &other) const {
+		if (! isSmoothing() && ! other.isSmoothing()) return true;
+		return start == other.start && target == other.target && position == other.position && length == other.length;
+	}
+
+	/**
+	 * Writes the values of the next samples to dest, advancing the ramp.
+	 */
+	template <typename SampleType>
+	void render(SampleType *dest, int numSamples){
+		const int ramp = juce::jlimit(0, numSamples, length - position);
+
+		if (ramp > 0){
+			const SampleType origin = start;
+			const SampleType increment = ((SampleType) target - (SampleType) start) / (SampleType) length;
+			const int offset = position + 1;
+
+			for (int i = 0; i < ramp; ++i){
+				dest[i] = origin + increment * (SampleType) (offset + i);
+			}
+		}
+
+		for (int i = ramp; i < numSamples; ++i){
+			dest[i] = (SampleType) target;
+		}
+
+		skip(ramp);
+	}
+
+	/**
+	 * Advances the ramp without rendering it.
+	 */
+	void skip(int numSamples){
+		position = juce::jmin(length, position + numSamples);
+
+		if (position == length){
+			current = target;
+		} else {
+			current = start + (target - start) * (float) position / (float) length;
+		}
+	}
+
+private:
+	float start = 0.0f;
+	float target = 0.0f;
+	float current = 0.0f;
+
+	/** How many samples of the ramp have passed. */
+	int position = 0;
+
+	/** The total length of the ramp, in samples. */
+	int length = 0;
+};
@@ -24,19 +24,26 @@
 //==============================================================================
 FaderVSTAudioProcessorEditor::FaderVSTAudioProcessorEditor (FaderVSTAudioProcessor& p, juce::AudioProcessorValueTreeState &tree)
     : AudioProcessorEditor (&p), audioProcessor (p), tree(tree),
+    gainValue(tree.getRawParameterValue("gain")),
     volumeRangeAttachment(volumeRange, *tree.getParameter("gainLow"), *tree.getParameter("gainHigh")),
     volumeRangeLowInputAttachment(volumeRangeLowInput, *tree.getParameter("gainLow")),
     volumeRangeHighInputAttachment(volumeRangeHighInput, *tree.getParameter("gainHigh")),
-    currentVolumeInputAttachment(currentVolumeInput, *tree.getParameter("gain"))
+    currentVolumeInputAttachment(currentVolumeInput, *tree.getParameter("gain")),
+    duckThresholdInputAttachment(duckThresholdInput, *tree.getParameter("duckThreshold")),
+    duckAttackInputAttachment(duckAttackInput, *tree.getParameter("duckAttack")),
+    duckHoldInputAttachment(duckHoldInput, *tree.getParameter("duckHold")),
+    duckReleaseInputAttachment(duckReleaseInput, *tree.getParameter("duckRelease"))
     {
 
     faded = false;
-    fadeDownTime = 1.0;
-    fadeUpTime = 1.0;
 
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (420, 370);
+   #if FADERVST_CPU_METER
+    setSize (420, 710);
+   #else
+    setSize (420, 662);
+   #endif
 
     // Configure the volume range slider
     volumeRange.setSliderStyle(juce::Slider::TwoValueHorizontal);
@@ -101,15 +108,36 @@ FaderVSTAudioProcessorEditor::FaderVSTAudioProcessorEditor (FaderVSTAudioProcess
     unlockCurrentVolumeLabel.setJustificationType(juce::Justification::centredLeft);
     // addAndMakeVisible(unlockCurrentVolumeLabel);
 
-    // Create the attachment to the gain parameter
-    currentVolumeAttachment.reset(new juce::ParameterAttachment(*tree.getParameter("gain"), [this](float value){
-      currentVolume.setValue(value, juce::sendNotificationSync);
+    // Follow the gain parameter, once per frame of the display
+    currentVolumeAttachment.reset(new juce::VBlankAttachment(&currentVolume, [this](){
+      const float value = gainValue->load();
+      if (value != displayedVolume && currentVolume.getThumbBeingDragged() < 0){
+        displayedVolume = value;
+        currentVolume.setValue(value, juce::dontSendNotification);
+      }
+    }));
+
+    // Show the levels measured by the processor while the editor is open
+    audioProcessor.setMeteringEnabled(true);
+    addAndMakeVisible(levelMeter);
+
+    levelMeterAttachment.reset(new juce::VBlankAttachment(&levelMeter, [this](){
+      LevelMeter::Reading reading;
+      levelMeter.update(audioProcessor.popLevels(reading) ? &reading : nullptr);
     }));
 
     // Configure the fade button
     fadeButton.setButtonText("Fade");
     fadeButton.onClick = std::bind(&FaderVSTAudioProcessorEditor::fade, this);
 
+    // Configure the fade group selector, with the item IDs offset by 1
+    fadeGroup.addItem("No group", 1);
+    for (int group = 1; group <= FadeGroups::numGroups; ++group){
+        fadeGroup.addItem("Group " + juce::String(group), group + 1);
+    }
+    fadeGroupAttachment.reset(new juce::AudioProcessorValueTreeState::ComboBoxAttachment(tree, "group", fadeGroup));
+    addAndMakeVisible(fadeGroup);
+
     // Configure the fade times textboxes
     fadeDownTimeInput.setEditable(true);
     fadeDownTimeInput.setJustificationType(juce::Justification::centredRight);
@@ -134,6 +162,10 @@ FaderVSTAudioProcessorEditor::FaderVSTAudioProcessorEditor (FaderVSTAudioProcess
     addAndMakeVisible(fadeUpTimeLabel);
 
     // Configure the keyboard shortcut buttons
+    enableKeyboardShortcut.setToggleState(audioProcessor.isKeyboardShortcutEnabled(), juce::dontSendNotification);
+    enableKeyboardShortcut.onClick = [this](){
+        audioProcessor.setKeyboardShortcutEnabled(enableKeyboardShortcut.getToggleState());
+    };
     addAndMakeVisible(enableKeyboardShortcut);
 
     enableKeyboardShortcutLabel.setText("Enable keyboard shortcut", juce::dontSendNotification);
@@ -141,13 +173,196 @@ FaderVSTAudioProcessorEditor::FaderVSTAudioProcessorEditor (FaderVSTAudioProcess
     enableKeyboardShortcutLabel.setJustificationType(juce::Justification::centredLeft);
     addAndMakeVisible(enableKeyboardShortcutLabel);
 
-    keyboardShortcutButton.setButtonText("Set shortcut");
+    if (audioProcessor.getKeyboardShortcut().isValid()){
+        keyboardShortcutButton.setButtonText(audioProcessor.getKeyboardShortcut().getTextDescription());
+    } else {
+        keyboardShortcutButton.setButtonText("Set shortcut");
+    }
     keyboardShortcutButton.onClick = [this](){
         keyboardShortcutState = KeyboardShortcutState::Registering;
         keyboardShortcutButton.setButtonText("Press a key...");
     };
     addAndMakeVisible(keyboardShortcutButton);
 
+    // Configure the fade curve selector
+    fadeCurve.addItemList(FadeCurve::getNames(), 1);
+    fadeCurveAttachment.reset(new juce::AudioProcessorValueTreeState::ComboBoxAttachment(tree, "curve", fadeCurve));
+    addAndMakeVisible(fadeCurve);
+
+    fadeCurveLabel.setText("Fade curve", juce::dontSendNotification);
+    fadeCurveLabel.setFont(labelFont);
+    fadeCurveLabel.setJustificationType(juce::Justification::centredLeft);
+    addAndMakeVisible(fadeCurveLabel);
+
+    // Configure the transport sync selectors
+    syncStart.addItemList(TransportSync::getStartNames(), 1);
+    syncStartAttachment.reset(new juce::AudioProcessorValueTreeState::ComboBoxAttachment(tree, "syncStart", syncStart));
+    addAndMakeVisible(syncStart);
+
+    durationUnit.addItemList(TransportSync::getUnitNames(), 1);
+    durationUnitAttachment.reset(new juce::AudioProcessorValueTreeState::ComboBoxAttachment(tree, "durationUnit", durationUnit));
+    addAndMakeVisible(durationUnit);
+
+    syncLabel.setText("Fade sync", juce::dontSendNotification);
+    syncLabel.setFont(labelFont);
+    syncLabel.setJustificationType(juce::Justification::centredLeft);
+    addAndMakeVisible(syncLabel);
+
+    // Configure the sidechain ducking controls
+    duckEnabledAttachment.reset(new juce::AudioProcessorValueTreeState::ButtonAttachment(tree, "duck", duckEnabled));
+    addAndMakeVisible(duckEnabled);
+
+    duckEnabledLabel.setText("Sidechain ducking", juce::dontSendNotification);
+    duckEnabledLabel.setFont(labelFont);
+    duckEnabledLabel.setJustificationType(juce::Justification::centredLeft);
+    addAndMakeVisible(duckEnabledLabel);
+
+    const auto configureDuckInput = [this](juce::Label &input, juce::Label &label, const juce::String &text){
+        input.setEditable(true);
+        input.setJustificationType(juce::Justification::centredRight);
+        input.setFont(inputFont);
+        addAndMakeVisible(input);
+
+        label.setText(text, juce::dontSendNotification);
+        label.setFont(labelFont);
+        label.setJustificationType(juce::Justification::centredLeft);
+        addAndMakeVisible(label);
+    };
+    configureDuckInput(duckThresholdInput, duckThresholdLabel, "Threshold (dB)");
+    configureDuckInput(duckAttackInput, duckAttackLabel, "Attack (ms)");
+    configureDuckInput(duckHoldInput, duckHoldLabel, "Hold (ms)");
+    configureDuckInput(duckReleaseInput, duckReleaseLabel, "Release (ms)");
+
+    // Configure the A/B crossfade checkbox
+    crossfadeEnabledAttachment.reset(new juce::AudioProcessorValueTreeState::ButtonAttachment(tree, "crossfade", crossfadeEnabled));
+    addAndMakeVisible(crossfadeEnabled);
+
+    crossfadeEnabledLabel.setText("Crossfade to the B input", juce::dontSendNotification);
+    crossfadeEnabledLabel.setFont(labelFont);
+    crossfadeEnabledLabel.setJustificationType(juce::Justification::centredLeft);
+    addAndMakeVisible(crossfadeEnabledLabel);
+
+    // Configure the OSC controls
+    oscPortLabel.setText("OSC port", juce::dontSendNotification);
+    oscPortLabel.setFont(labelFont);
+    oscPortLabel.setJustificationType(juce::Justification::centredLeft);
+    addAndMakeVisible(oscPortLabel);
+
+    oscPortInput.setEditable(true);
+    oscPortInput.setJustificationType(juce::Justification::centredRight);
+    oscPortInput.setText(audioProcessor.getOscPort() > 0 ? juce::String(audioProcessor.getOscPort()) : "Off", juce::dontSendNotification);
+    oscPortInput.setFont(inputFont);
+    oscPortInput.addListener(this);
+    addAndMakeVisible(oscPortInput);
+
+    oscStatusLabel.setFont(labelFont);
+    oscStatusLabel.setJustificationType(juce::Justification::centredLeft);
+    addAndMakeVisible(oscStatusLabel);
+
+    updateOscStatus();
+
+    // Configure the cue list controls
+    cuesLabel.setFont(labelFont);
+    cuesLabel.setJustificationType(juce::Justification::centredLeft);
+    addAndMakeVisible(cuesLabel);
+
+    loadCuesButton.setButtonText("Load cues...");
+    loadCuesButton.onClick = [this](){
+        cuesChooser = std::make_unique<juce::FileChooser>("Load a cue list", juce::File(), "*.txt;*.csv");
+        cuesChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles, [this](const juce::FileChooser &chooser){
+            const auto file = chooser.getResult();
+            if (file.existsAsFile()){
+                audioProcessor.setCues(CueList::parse(file.loadFileAsString()));
+                updateCues();
+            }
+        });
+    };
+    addAndMakeVisible(loadCuesButton);
+
+    updateCues();
+
+    // Configure the preset controls
+    programLabel.setText("Preset", juce::dontSendNotification);
+    programLabel.setFont(labelFont);
+    programLabel.setJustificationType(juce::Justification::centredLeft);
+    addAndMakeVisible(programLabel);
+
+    // The item IDs are the program indices, offset by 1
+    for (int index = 0; index < audioProcessor.getNumPrograms(); ++index){
+        programSelector.addItem(audioProcessor.getProgramName(index), index + 1);
+    }
+    programSelector.setSelectedId(audioProcessor.getCurrentProgram() + 1, juce::dontSendNotification);
+    programSelector.onChange = [this](){
+        audioProcessor.setCurrentProgram(programSelector.getSelectedId() - 1);
+        updateSettings();
+    };
+    addAndMakeVisible(programSelector);
+
+    storeProgramButton.setButtonText("Store preset");
+    storeProgramButton.onClick = [this](){
+        audioProcessor.storeProgram(programSelector.getSelectedId() - 1);
+    };
+    addAndMakeVisible(storeProgramButton);
+
+    updateSettings();
+
+   #if FADERVST_CPU_METER
+    // Configure the CPU load display
+    cpuLoadLabel.setFont(labelFont);
+    cpuLoadLabel.setJustificationType(juce::Justification::centredLeft);
+    addAndMakeVisible(cpuLoadLabel);
+
+    cpuLoadResetButton.setButtonText("Reset");
+    cpuLoadResetButton.onClick = [this](){
+        audioProcessor.resetCpuLoad();
+    };
+    addAndMakeVisible(cpuLoadResetButton);
+
+    updateCpuLoad();
+   #endif
+
+
+    // Configure the MIDI trigger controls
+    midiTriggerLabel.setText("MIDI trigger", juce::dontSendNotification);
+    midiTriggerLabel.setFont(labelFont);
+    midiTriggerLabel.setJustificationType(juce::Justification::centredLeft);
+    addAndMakeVisible(midiTriggerLabel);
+
+    // The item IDs are the fade command targets, offset by 1
+    midiTriggerAction.addItem("Fade", FadeCommand::Toggle + 1);
+    midiTriggerAction.addItem("Fade down", FadeCommand::Down + 1);
+    midiTriggerAction.addItem("Fade up", FadeCommand::Up + 1);
+    midiTriggerAction.addItem("Stop", FadeCommand::Stop + 1);
+    midiTriggerAction.setSelectedId(FadeCommand::Toggle + 1, juce::dontSendNotification);
+    midiTriggerAction.onChange = [this](){
+        audioProcessor.cancelMidiLearn();
+        updateMidiTrigger();
+    };
+    addAndMakeVisible(midiTriggerAction);
+
+    midiTriggerDurationInput.setEditable(true);
+    midiTriggerDurationInput.setJustificationType(juce::Justification::centredRight);
+    midiTriggerDurationInput.setText("1.0", juce::dontSendNotification);
+    midiTriggerDurationInput.setFont(inputFont);
+    midiTriggerDurationInput.addListener(this);
+    addAndMakeVisible(midiTriggerDurationInput);
+
+    midiLearnButton.onClick = [this](){
+        if (audioProcessor.isLearningMidi()){
+            audioProcessor.cancelMidiLearn();
+        } else {
+            audioProcessor.learnMidiMapping(
+                getMidiTriggerSlot(),
+                (FadeCommand::Target) getMidiTriggerSlot(),
+                midiTriggerDurationInput.getText().getDoubleValue()
+            );
+        }
+        updateMidiTrigger();
+    };
+    addAndMakeVisible(midiLearnButton);
+
+    updateMidiTrigger();
+    startTimerHz(10);
 
     // Add the sliders to the window
     addAndMakeVisible(volumeRange);
@@ -162,6 +377,7 @@ FaderVSTAudioProcessorEditor::FaderVSTAudioProcessorEditor (FaderVSTAudioProcess
 }
 
 FaderVSTAudioProcessorEditor::~FaderVSTAudioProcessorEditor() {
+    audioProcessor.setMeteringEnabled(false);
 }
 
 //==============================================================================
@@ -183,6 +399,7 @@ void FaderVSTAudioProcessorEditor::resized(){
 
     // Set the position of the current volume slider
     currentVolume.setBounds(24, 142, 372, 24);
+    levelMeter.setBounds(32, 167, 356, 10);
 
     currentVolumeLabel.setBounds(32, 106, 91, 18);
     currentVolumeInput.setBounds(123, 103, 40, 22);
@@ -201,17 +418,61 @@ void FaderVSTAudioProcessorEditor::resized(){
 
     keyboardShortcutButton.setBounds(242, 230, 142, 18);
 
+    fadeCurveLabel.setBounds(32, 264, 100, 18);
+    fadeCurve.setBounds(242, 262, 142, 22);
+
+    midiTriggerLabel.setBounds(32, 300, 80, 18);
+    midiTriggerAction.setBounds(120, 298, 100, 22);
+    midiTriggerDurationInput.setBounds(228, 298, 40, 22);
+    midiLearnButton.setBounds(276, 298, 108, 22);
+
+    syncLabel.setBounds(32, 336, 80, 18);
+    syncStart.setBounds(120, 334, 130, 22);
+    durationUnit.setBounds(258, 334, 126, 22);
+
+    cuesLabel.setBounds(32, 372, 200, 18);
+    loadCuesButton.setBounds(242, 370, 142, 22);
+
+    programLabel.setBounds(32, 408, 80, 18);
+    programSelector.setBounds(120, 406, 130, 22);
+    storeProgramButton.setBounds(258, 406, 126, 22);
+
+    duckEnabled.setBounds(32, 444, 200, 18);
+    duckEnabledLabel.setBounds(62, 444, 170, 18);
+    duckThresholdLabel.setBounds(242, 444, 100, 18);
+    duckThresholdInput.setBounds(334, 442, 54, 22);
+
+    duckAttackLabel.setBounds(32, 480, 76, 18);
+    duckAttackInput.setBounds(108, 478, 42, 22);
+    duckHoldLabel.setBounds(154, 480, 64, 18);
+    duckHoldInput.setBounds(218, 478, 42, 22);
+    duckReleaseLabel.setBounds(264, 480, 82, 18);
+    duckReleaseInput.setBounds(346, 478, 42, 22);
+
+    crossfadeEnabled.setBounds(32, 516, 356, 18);
+    crossfadeEnabledLabel.setBounds(62, 516, 326, 18);
+
+    oscPortLabel.setBounds(32, 552, 70, 18);
+    oscPortInput.setBounds(102, 550, 60, 22);
+    oscStatusLabel.setBounds(172, 552, 216, 18);
+
     // Set the position of the fade button
-    fadeButton.setBounds(32, 300, 356, 36);
+    fadeButton.setBounds(32, 592, 240, 36);
+    fadeGroup.setBounds(284, 599, 104, 22);
+
+   #if FADERVST_CPU_METER
+    cpuLoadLabel.setBounds(32, 640, 280, 36);
+    cpuLoadResetButton.setBounds(318, 647, 66, 22);
+   #endif
 }
 
 void FaderVSTAudioProcessorEditor::fade(){
     if (this->faded){
         faded = false;
-        this->audioProcessor.fadeUp(this->fadeUpTime);
+        this->audioProcessor.fadeUp(this->audioProcessor.getFadeUpTime());
     } else {
         faded = true;
-        this->audioProcessor.fadeDown(this->fadeDownTime);
+        this->audioProcessor.fadeDown(this->audioProcessor.getFadeDownTime());
     }
 }
 
@@ -219,23 +480,126 @@ void FaderVSTAudioProcessorEditor::labelTextChanged(juce::Label *label){
     juce::String text = label->getText();
     double value = text.getDoubleValue();
     if (label == &fadeDownTimeInput){
-      fadeDownTime = value;
+      audioProcessor.setFadeDownTime(value);
     } else if (label == &fadeUpTimeInput){
-      fadeUpTime = value;
+      audioProcessor.setFadeUpTime(value);
+    } else if (label == &oscPortInput){
+      if (! audioProcessor.setOscPort(text.getIntValue())){
+        // Show the port that failed, rather than what was typed
+        oscPortInput.setText(juce::String(audioProcessor.getOscPort()), juce::dontSendNotification);
+      }
+      updateOscStatus();
+    } else if (label == &midiTriggerDurationInput){
+      // Change the duration of the mapping that is already there
+      auto &mappings = audioProcessor.getMidiMappings();
+      auto mapping = mappings.get(getMidiTriggerSlot());
+      if (mapping.isActive()){
+          mapping.duration = value;
+          mappings.set(getMidiTriggerSlot(), mapping);
+      }
+    }
+}
+
+int FaderVSTAudioProcessorEditor::getMidiTriggerSlot() const {
+    return midiTriggerAction.getSelectedId() - 1;
+}
+
+void FaderVSTAudioProcessorEditor::updateMidiTrigger(){
+    if (audioProcessor.isLearningMidi()){
+        midiLearnButton.setButtonText("Send MIDI...");
+        return;
+    }
+
+    const auto mapping = audioProcessor.getMidiMappings().get(getMidiTriggerSlot());
+    if (mapping.isActive()){
+        midiLearnButton.setButtonText(mapping.trigger.getDescription());
+        if (! midiTriggerDurationInput.isBeingEdited()){
+            midiTriggerDurationInput.setText(juce::String(mapping.duration), juce::dontSendNotification);
+        }
+    } else {
+        midiLearnButton.setButtonText("Learn MIDI");
+    }
+}
+
+void FaderVSTAudioProcessorEditor::updateCues(){
+    const auto numCues = (int) audioProcessor.getCues().size();
+    cuesLabel.setText("Cue list (" + juce::String(numCues) + (numCues == 1 ? " cue)" : " cues)"), juce::dontSendNotification);
+}
+
+void FaderVSTAudioProcessorEditor::updateSettings(){
+    if (! fadeDownTimeInput.isBeingEdited()){
+        fadeDownTimeInput.setText(juce::String(audioProcessor.getFadeDownTime()), juce::dontSendNotification);
+    }
+    if (! fadeUpTimeInput.isBeingEdited()){
+        fadeUpTimeInput.setText(juce::String(audioProcessor.getFadeUpTime()), juce::dontSendNotification);
+    }
+
+    programSelector.setSelectedId(audioProcessor.getCurrentProgram() + 1, juce::dontSendNotification);
+}
+
+void FaderVSTAudioProcessorEditor::updateOscStatus(){
+    // A port that could not be used stays marked until another one is set
+    const bool failed = audioProcessor.getOscPort() != 0 && ! audioProcessor.isOscListening();
+    oscStatusLabel.setColour(juce::Label::textColourId, failed ? juce::Colours::red : getLookAndFeel().findColour(juce::Label::textColourId));
+
+    if (audioProcessor.getOscPort() == 0){
+        oscStatusLabel.setText("Not listening", juce::dontSendNotification);
+    } else if (failed){
+        oscStatusLabel.setText("Port " + juce::String(audioProcessor.getOscPort()) + " unavailable", juce::dontSendNotification);
+    } else {
+        const auto latency = audioProcessor.getOscLatency();
+        const int numDropped = audioProcessor.getOscNumDropped();
+        oscStatusLabel.setText(
+            (latency.count == 0 ? juce::String("Listening")
+                                : "Latency " + juce::String(latency.last, 2) + " ms (max " + juce::String(latency.max, 2) + ")")
+            + (numDropped > 0 ? ", " + juce::String(numDropped) + " dropped" : juce::String()),
+            juce::dontSendNotification
+        );
+    }
+}
+
+#if FADERVST_CPU_METER
+void FaderVSTAudioProcessorEditor::updateCpuLoad(){
+    const auto stats = audioProcessor.getCpuLoad();
+    if (stats.numCalls == 0){
+        cpuLoadLabel.setText("CPU load: not measured yet", juce::dontSendNotification);
+        return;
     }
+
+    const auto percent = [](double value){
+        return juce::String(value, 2) + "%";
+    };
+
+    cpuLoadLabel.setText(
+        "CPU min " + percent(stats.minLoad) + ", avg " + percent(stats.averageLoad)
+        + ", p99 " + percent(stats.p99Load) + ", max " + percent(stats.maxLoad) + "\n"
+        + juce::String(stats.averageTime / 1000.0, 1) + " us per block, "
+        + juce::String(stats.timePerSample, 1) + " ns per sample",
+        juce::dontSendNotification
+    );
+}
+#endif
+
+void FaderVSTAudioProcessorEditor::timerCallback(){
+    updateMidiTrigger();
+    updateSettings();
+    updateOscStatus();
+   #if FADERVST_CPU_METER
+    updateCpuLoad();
+   #endif
 }
 
 bool FaderVSTAudioProcessorEditor::keyPressed(const juce::KeyPress &key){
     switch (keyboardShortcutState) {
         case KeyboardShortcutState::Registering:
-            keyboardShortcut = new juce::KeyPress(key);
-            keyboardShortcutButton.setButtonText(keyboardShortcut->getTextDescription());
+            audioProcessor.setKeyboardShortcut(key);
+            keyboardShortcutButton.setButtonText(key.getTextDescription());
             keyboardShortcutState = KeyboardShortcutState::Listening;
             break;
 
         case KeyboardShortcutState::Listening:
-            if (enableKeyboardShortcut.getToggleState() && keyboardShortcut){
-                if (key == *keyboardShortcut){
+            if (audioProcessor.isKeyboardShortcutEnabled() && audioProcessor.getKeyboardShortcut().isValid()){
+                if (key == audioProcessor.getKeyboardShortcut()){
                     fade();
                 }
             }
@@ -23,10 +23,11 @@
 #include "fonts.h"
 #include "TwoValueSliderAttachment.h"
 #include "LabelAttachment.h"
+#include "LevelMeterComponent.h"
 #include "PluginProcessor.h"
 #include <array>
 
-class FaderVSTAudioProcessorEditor : public juce::AudioProcessorEditor, public juce::Label::Listener {
+class FaderVSTAudioProcessorEditor : public juce::AudioProcessorEditor, public juce::Label::Listener, private juce::Timer {
 public:
     FaderVSTAudioProcessorEditor (FaderVSTAudioProcessor&, juce::AudioProcessorValueTreeState&);
     ~FaderVSTAudioProcessorEditor() override;
@@ -45,6 +46,12 @@ private:
     FaderVSTAudioProcessor& audioProcessor;
     juce::AudioProcessorValueTreeState &tree;
 
+    /** The value of the gain parameter, read once per frame of the display. */
+    std::atomic<float> *gainValue;
+
+    /** Keeps the bundled typefaces alive while the editor is open. */
+    juce::SharedResourcePointer<fonts::Typefaces> typefaces;
+
     /**
      * The font used in input boxes.
      */
@@ -102,6 +109,17 @@ private:
      */
     juce::Label currentVolumeLabel;
 
+    /**
+     * Shows the levels of the input and the output, under currentVolume.
+     */
+    LevelMeterComponent levelMeter;
+
+    /**
+     * Moves levelMeter to the levels measured by the processor, once per
+     * frame of the display.
+     */
+    std::unique_ptr<juce::VBlankAttachment> levelMeterAttachment;
+
     /**
      * A checkbox that can allow freely changing the gain through its slider.
      */
@@ -115,6 +133,13 @@ private:
 
     juce::TextButton fadeButton;
 
+    /**
+     * A selector for the fade group of the instance.
+     */
+    juce::ComboBox fadeGroup;
+
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> fadeGroupAttachment;
+
     /**
      * The input for the fade down time duration.
      */
@@ -151,6 +176,164 @@ private:
      */
     juce::TextButton keyboardShortcutButton;
 
+    /**
+     * A selector for the shape of the fades.
+     */
+    juce::ComboBox fadeCurve;
+
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> fadeCurveAttachment;
+
+    /**
+     * The label for the fadeCurve selector.
+     */
+    juce::Label fadeCurveLabel;
+
+    /**
+     * A selector for where the fades start: immediately, or on the next beat
+     * or bar of the host.
+     */
+    juce::ComboBox syncStart;
+
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> syncStartAttachment;
+
+    /**
+     * A selector for the unit of the fade times.
+     */
+    juce::ComboBox durationUnit;
+
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> durationUnitAttachment;
+
+    /**
+     * The label for the syncStart and durationUnit selectors.
+     */
+    juce::Label syncLabel;
+
+    /**
+     * A checkbox that lets the sidechain drive the fades.
+     */
+    juce::ToggleButton duckEnabled;
+
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> duckEnabledAttachment;
+
+    /**
+     * The label for the duckEnabled checkbox.
+     */
+    juce::Label duckEnabledLabel;
+
+    /**
+     * The inputs for the settings of the ducking, and their labels.
+     */
+    juce::Label duckThresholdInput;
+    LabelAttachment duckThresholdInputAttachment;
+    juce::Label duckThresholdLabel;
+
+    juce::Label duckAttackInput;
+    LabelAttachment duckAttackInputAttachment;
+    juce::Label duckAttackLabel;
+
+    juce::Label duckHoldInput;
+    LabelAttachment duckHoldInputAttachment;
+    juce::Label duckHoldLabel;
+
+    juce::Label duckReleaseInput;
+    LabelAttachment duckReleaseInputAttachment;
+    juce::Label duckReleaseLabel;
+
+    /**
+     * A checkbox that makes the fades crossfade to the B input.
+     */
+    juce::ToggleButton crossfadeEnabled;
+
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> crossfadeEnabledAttachment;
+
+    /**
+     * The label for the crossfadeEnabled checkbox.
+     */
+    juce::Label crossfadeEnabledLabel;
+
+    /**
+     * The input for the port that OSC messages are received on.
+     */
+    juce::Label oscPortInput;
+
+    /**
+     * The label for oscPortInput.
+     */
+    juce::Label oscPortLabel;
+
+    /**
+     * Shows whether OSC messages are received, and how long they take to
+     * reach the audio thread.
+     */
+    juce::Label oscStatusLabel;
+
+    /**
+     * The label for the cue list, which also shows its length.
+     */
+    juce::Label cuesLabel;
+
+    /**
+     * A button that loads the cue list from a file.
+     */
+    juce::TextButton loadCuesButton;
+
+    /**
+     * The file chooser opened by loadCuesButton.
+     */
+    std::unique_ptr<juce::FileChooser> cuesChooser;
+
+    /**
+     * The label for the preset controls.
+     */
+    juce::Label programLabel;
+
+    /**
+     * A selector that recalls a program of the preset bank.
+     */
+    juce::ComboBox programSelector;
+
+    /**
+     * A button that stores the current settings in the selected program.
+     */
+    juce::TextButton storeProgramButton;
+
+   #if FADERVST_CPU_METER
+    /**
+     * Shows the statistics of the time taken by the audio processing.
+     */
+    juce::Label cpuLoadLabel;
+
+    /**
+     * A button that resets the statistics shown in cpuLoadLabel.
+     */
+    juce::TextButton cpuLoadResetButton;
+   #endif
+
+    /**
+     * The label for the MIDI trigger controls.
+     */
+    juce::Label midiTriggerLabel;
+
+    /**
+     * A selector for the fade that the MIDI trigger being shown or learned
+     * starts.
+     *
+     * Each kind of fade has its own slot in the MIDI mappings of the
+     * processor.
+     */
+    juce::ComboBox midiTriggerAction;
+
+    /**
+     * The input for the duration of the fade started by the MIDI trigger.
+     */
+    juce::Label midiTriggerDurationInput;
+
+    /**
+     * A button that starts learning a MIDI trigger, and displays the current
+     * one.
+     */
+    juce::TextButton midiLearnButton;
+
     enum KeyboardShortcutState {
         /**
          * Listening for a keyboard shortcut to be registered as the main
@@ -163,13 +346,16 @@ private:
         Listening,
     };
     KeyboardShortcutState keyboardShortcutState = KeyboardShortcutState::Listening;
-    juce::KeyPress *keyboardShortcut = nullptr;
 
 
-    std::unique_ptr<juce::ParameterAttachment> currentVolumeAttachment;
+    /**
+     * Moves currentVolume to the value of the gain parameter, once per frame
+     * of the display.
+     */
+    std::unique_ptr<juce::VBlankAttachment> currentVolumeAttachment;
 
-    double fadeDownTime;
-    double fadeUpTime;
+    /** The value of the gain that currentVolume was last moved to. */
+    float displayedVolume = std::numeric_limits<float>::quiet_NaN();
 
     /**
      * Whether the audio is faded (or in the process of fading).
@@ -180,5 +366,40 @@ private:
 
     void fade();
 
+    /**
+     * Returns the slot of the MIDI mappings for the selected fade action.
+     */
+    int getMidiTriggerSlot() const;
+
+    /**
+     * Updates the MIDI trigger controls to show the selected mapping.
+     */
+    void updateMidiTrigger();
+
+    /**
+     * Shows the length of the cue list in cuesLabel.
+     */
+    void updateCues();
+
+    /**
+     * Shows the settings kept in the processor that may have changed, such
+     * as the fade times after recalling a program.
+     */
+    void updateSettings();
+
+    /**
+     * Shows the state of the OSC listener in oscStatusLabel.
+     */
+    void updateOscStatus();
+
+   #if FADERVST_CPU_METER
+    /**
+     * Shows the latest statistics of the CPU load in cpuLoadLabel.
+     */
+    void updateCpuLoad();
+   #endif
+
+    void timerCallback() override;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FaderVSTAudioProcessorEditor)
 };
@@ -20,6 +20,8 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "RealtimeAudit.h"
+#include <algorithm>
 
 //==============================================================================
 FaderVSTAudioProcessor::FaderVSTAudioProcessor()
@@ -27,6 +29,8 @@ FaderVSTAudioProcessor::FaderVSTAudioProcessor()
      : AudioProcessor (BusesProperties()
                        .withInput  ("Input",  juce::AudioChannelSet::stereo(), true)
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
+                       .withInput  ("Sidechain", juce::AudioChannelSet::stereo(), false)
+                       .withInput  ("B", juce::AudioChannelSet::stereo(), false)
                        )
 #else
     : AudioProcessor()
@@ -36,15 +40,71 @@ FaderVSTAudioProcessor::FaderVSTAudioProcessor()
     std::make_unique<juce::AudioParameterFloat>("gainHigh", "High Gain", 0.0, 1.0, 1.0),
     std::make_unique<juce::AudioParameterFloat>("gain", "Gain", 0.0, 1.0, 1.0),
     std::make_unique<juce::AudioParameterBool>("fading", "Is Fading", true),
+    std::make_unique<juce::AudioParameterChoice>("curve", "Fade Curve", FadeCurve::getNames(), FadeCurve::Linear),
+    std::make_unique<juce::AudioParameterFloat>("smoothing", "Smoothing Time (ms)", 0.0, 1000.0, 20.0),
+    std::make_unique<juce::AudioParameterChoice>("syncStart", "Fade Start", TransportSync::getStartNames(), TransportSync::Immediately),
+    std::make_unique<juce::AudioParameterChoice>("durationUnit", "Fade Time Unit", TransportSync::getUnitNames(), TransportSync::Seconds),
+    std::make_unique<juce::AudioParameterInt>("group", "Fade Group", 0, FadeGroups::numGroups, 0),
+    std::make_unique<juce::AudioParameterBool>("duck", "Sidechain Ducking", false),
+    std::make_unique<juce::AudioParameterFloat>("duckThreshold", "Duck Threshold (dB)", -60.0, 0.0, -30.0),
+    std::make_unique<juce::AudioParameterFloat>("duckAttack", "Duck Attack (ms)", 0.0, 1000.0, 10.0),
+    std::make_unique<juce::AudioParameterFloat>("duckHold", "Duck Hold (ms)", 0.0, 5000.0, 250.0),
+    std::make_unique<juce::AudioParameterFloat>("duckRelease", "Duck Release (ms)", 0.0, 5000.0, 500.0),
+    std::make_unique<juce::AudioParameterBool>("crossfade", "A/B Crossfade", false),
 }) {
     gainLow = parameters.getRawParameterValue("gainLow");
     gainHigh = parameters.getRawParameterValue("gainHigh");
+    gainLowParameter = parameters.getParameter("gainLow");
+    gainHighParameter = parameters.getParameter("gainHigh");
     gain = parameters.getRawParameterValue("gain");
     fading = parameters.getRawParameterValue("fading");
-    fadeDuration = 0;
+    curve = parameters.getRawParameterValue("curve");
+    smoothingTime = parameters.getRawParameterValue("smoothing");
+    syncStart = parameters.getRawParameterValue("syncStart");
+    durationUnit = parameters.getRawParameterValue("durationUnit");
+    fadeGroup = parameters.getRawParameterValue("group");
+    duck = parameters.getRawParameterValue("duck");
+    duckThreshold = parameters.getRawParameterValue("duckThreshold");
+    duckAttack = parameters.getRawParameterValue("duckAttack");
+    duckHold = parameters.getRawParameterValue("duckHold");
+    duckRelease = parameters.getRawParameterValue("duckRelease");
+    crossfade = parameters.getRawParameterValue("crossfade");
+    sampleRate = 44100.0;
+
+    fadeEngine.reset(gainLow->load(), gainHigh->load(), gain->load());
+
+    for (size_t i = 0; i < programParameterIDs.size(); ++i){
+        programParameters[i] = parameters.getRawParameterValue(programParameterIDs[i]);
+    }
+
+    // Every program starts with the default settings
+    for (int index = 0; index < numPrograms; ++index){
+        programs[(size_t) index].name = "Preset " + juce::String(index + 1);
+        storeProgram(index);
+    }
+
+    requestedGain = std::numeric_limits<float>::quiet_NaN();
+    requestedFading = std::numeric_limits<float>::quiet_NaN();
+    requestedRangeLow = std::numeric_limits<float>::quiet_NaN();
+    requestedRangeHigh = std::numeric_limits<float>::quiet_NaN();
+    parameters.addParameterListener("gain", this);
+    parameters.addParameterListener("fading", this);
+
+    setTelemetryRate(60);
+
+    // Create the fade groups of the process now, rather than on the audio
+    // thread
+    FadeGroups::initialise();
+
+    // Build the lookup tables of the curves now, rather than on the audio
+    // thread when they are first needed
+    FadeCurve::getTable(FadeCurve::Linear);
 }
 
 FaderVSTAudioProcessor::~FaderVSTAudioProcessor(){
+    stopTimer();
+    parameters.removeParameterListener("gain", this);
+    parameters.removeParameterListener("fading", this);
 }
 
 const juce::String FaderVSTAudioProcessor::getName() const {
@@ -80,60 +140,95 @@ double FaderVSTAudioProcessor::getTailLengthSeconds() const {
 }
 
 int FaderVSTAudioProcessor::getNumPrograms(){
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    return numPrograms;
 }
 
 int FaderVSTAudioProcessor::getCurrentProgram(){
-    return 0;
+    return currentProgram;
 }
 
 void FaderVSTAudioProcessor::setCurrentProgram(int index){
+    if (! juce::isPositiveAndBelow(index, numPrograms)) return;
+
+    // Hosts may recall programs from the audio thread, so only atomics are
+    // written here. The range glides to its new values like after any other
+    // change. On the message thread the host is notified before returning,
+    // and otherwise by the next timerCallback().
+    const auto &program = programs[(size_t) index];
+    for (size_t i = 0; i < programParameters.size(); ++i){
+        programParameters[i]->store(program.values[i].load());
+    }
+    fadeDownTime = program.fadeDownTime.load();
+    fadeUpTime = program.fadeUpTime.load();
+
+    currentProgram = index;
+    recalledProgram = index;
+
+    if (juce::MessageManager::existsAndIsCurrentThread()){
+        reportRecalledProgram();
+    }
 }
 
 const juce::String FaderVSTAudioProcessor::getProgramName(int index){
-    return {};
+    if (! juce::isPositiveAndBelow(index, numPrograms)) return {};
+    return programs[(size_t) index].name;
 }
 
 void FaderVSTAudioProcessor::changeProgramName(int index, const juce::String& newName){
+    if (! juce::isPositiveAndBelow(index, numPrograms)) return;
+    programs[(size_t) index].name = newName;
 }
 
-void FaderVSTAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock){
-    this->sampleRate = sampleRate;
-}
+void FaderVSTAudioProcessor::storeProgram(int index){
+    if (! juce::isPositiveAndBelow(index, numPrograms)) return;
 
-void FaderVSTAudioProcessor::releaseResources(){
-    // When playback stops, you can use this as an opportunity to free up any
-    // spare memory, etc.
+    auto &program = programs[(size_t) index];
+    for (size_t i = 0; i < programParameters.size(); ++i){
+        program.values[i] = programParameters[i]->load();
+    }
+    program.fadeDownTime = fadeDownTime.load();
+    program.fadeUpTime = fadeUpTime.load();
 }
 
-#ifndef JucePlugin_PreferredChannelConfigurations
-bool FaderVSTAudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const {
-#if JucePlugin_IsMidiEffect
-    juce::ignoreUnused (layouts);
-    return true;
-#else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    // Some plugin hosts, such as certain GarageBand versions, will only
-    // load plugins that support stereo bus layouts.
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
-        return false;
+void FaderVSTAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock){
+    this->sampleRate = sampleRate;
 
-    // This checks if the input layout matches the output layout
-    #if ! JucePlugin_IsSynth
-    if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet()){
-        return false;
-    }
-    #endif
+    // Start from the current range, without gliding to it, and keep any
+    // fade in progress at the same length in time
+    fadeEngine.prepare(sampleRate, getFadeParameters(), getMainBusNumOutputChannels());
 
+    // The sidechain is only measured, and the B input is mixed into the
+    // channels it has (or all of them, if it is mono), so they can have any
+    // layout or be disabled
     return true;
 #endif
 }
 #endif
 
+bool FaderVSTAudioProcessor::supportsDoublePrecisionProcessing() const {
+    return true;
+}
+
 void FaderVSTAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages){
+   #if FADERVST_RT_AUDIT
+    const RealtimeAudit::ScopedAudioThread audit;
+   #endif
+    process(buffer, midiMessages);
+}
+
+void FaderVSTAudioProcessor::processBlock(juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages){
+   #if FADERVST_RT_AUDIT
+    const RealtimeAudit::ScopedAudioThread audit;
+   #endif
+    process(buffer, midiMessages);
+}
+
+template <typename SampleType>
+void FaderVSTAudioProcessor::process(juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages){
+   #if FADERVST_CPU_METER
+    const CpuLoadMeter::ScopedMeasurement measurement(cpuLoadMeter, buffer.getNumSamples(), sampleRate);
+   #endif
+
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -147,69 +242,532 @@ void FaderVSTAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-    if (fadeDuration == 0){
-        // When the fade duration is 0, make instant changes
-        if (*fading < 0.5){
-            // Set the gain to the low point instantly
-            *gain = gainLow->load();
+    const int numSamples = buffer.getNumSamples();
+
+    // The gain is only applied to the main bus, and not to the sidechain
+    auto mainBuffer = getBusBuffer(buffer, false, 0);
+
+    // In the A/B mode, the B input is mixed in as the main input fades out
+    const auto inputBBuffer = getBusBuffer(buffer, true, 2);
+    const auto *inputB = crossfade->load() >= 0.5f && inputBBuffer.getNumChannels() > 0 ? &inputBBuffer : nullptr;
+
+    metering = meteringEnabled.load(std::memory_order_relaxed);
+    inputLevels = {};
+    outputLevels = {};
+
+    // Read the parameters once, so that the whole block is processed with
+    // the same values however the host splits it
+    fadeEngine.setParameters(getFadeParameters());
+
+    // Pick up any changes made to the parameters from outside
+    const float newGain = requestedGain.exchange(std::numeric_limits<float>::quiet_NaN());
+    if (! std::isnan(newGain)){
+        fadeEngine.glideTo(newGain);
+    }
+    const float newFading = requestedFading.exchange(std::numeric_limits<float>::quiet_NaN());
+    if (! std::isnan(newFading)){
+        fadeEngine.jumpTo(newFading);
+    }
+
+    // Follow the transport, converting the musical positions to samples
+    // again only when the tempo changes or the transport jumps
+    if (transport.update(getPlayHead(), sampleRate, numSamples)){
+        if (fadeScheduled){
+            rescheduleFade();
+        }
+        if (fadeEngine.isFading()){
+            // Keep the fades in time, from the points they have reached
+            fadeEngine.rescale(transport.getSamplesPerBeat());
+        }
+    }
+
+    // Gather the commands that take effect in this block, from the queue,
+    // the fade group and MIDI, in the order of their timestamps
+    numBlockCommands = 0;
+
+    // The clock of the fade group follows the position of the host while it
+    // is rolling, which all the members share
+    groupMember.setGroup((int) fadeGroup->load());
+    const auto hostTime = transport.isPlaying() ? (juce::int64) std::llround(transport.getTime() * sampleRate) : (juce::int64) -1;
+    groupMember.process(hostTime, numSamples, [this](FadeCommand::Target target, double duration, bool durationInSeconds, int offset, juce::int64 elapsed){
+        FadeCommand command { target, duration, sampleClock + offset, true, durationInSeconds };
+        command.elapsed = elapsed;
+        addBlockCommand(command);
+    });
+
+    if (fadeScheduled && scheduledFade.timestamp < sampleClock + numSamples){
+        fadeScheduled = false;
+        addBlockCommand(scheduledFade);
+    }
+
+    // The cues are already placed on the timeline, so they are not moved to
+    // the grid
+    if (transport.isPlaying()){
+        cueList.process(transport.getTime(), numSamples, sampleRate, transport.hasRelocated(), [this](const Cue &cue, int offset){
+            addBlockCommand({ cue.target, cue.duration, sampleClock + offset, false });
+        });
+    }
+
+    FadeCommand command;
+    while (numBlockCommands < maxBlockCommands && fadeCommands.peek(command) && command.timestamp < sampleClock + numSamples){
+        fadeCommands.pop();
+        addBlockCommand(command);
+    }
+
+    handleMidi(midiMessages);
+
+    handleRemoteCommands();
+
+    handleSidechain(buffer);
+
+    // Apply the commands at their exact sample, processing the part of the
+    // block before each one with the old state
+    int position = 0;
+    for (int i = 0; i < numBlockCommands; ++i){
+        // Copied, since moving it to the grid may add commands after it
+        const auto blockCommand = blockCommands[(size_t) i];
+
+        const int offset = (int) juce::jlimit<juce::int64>(position, numSamples, blockCommand.timestamp - sampleClock);
+        processSegment(mainBuffer, inputB, position, offset - position);
+        position = offset;
+
+        if (! scheduleFade(blockCommand, offset, numSamples)){
+            applyFadeCommand(blockCommand);
+        }
+    }
+    processSegment(mainBuffer, inputB, position, numSamples - position);
+
+    sampleClock += numSamples;
+    publishedSampleClock.store(sampleClock, std::memory_order_release);
+
+    if (metering){
+        levelReadings.push({ inputLevels.peak, inputLevels.getRms(), outputLevels.peak, outputLevels.getRms() });
+    }
+
+    // The host is notified of the new state from the message thread, by
+    // timerCallback()
+    telemetry.publish({ fadeEngine.getCurrentGain(), fadeEngine.getDirection() });
+}
+
+void FaderVSTAudioProcessor::applyFadeCommand(const FadeCommand &command){
+    // Automated parameters change at the sample of the command, so the part
+    // of the block before it keeps the old values
+    switch (command.target){
+        case FadeCommand::SetGain:
+            fadeEngine.glideTo(command.value);
+            return;
+
+        case FadeCommand::SetFading:
+            fadeEngine.jumpTo(command.value);
+            return;
+
+        case FadeCommand::SetGainLow:
+        case FadeCommand::SetGainHigh: {
+            auto &parameter = command.target == FadeCommand::SetGainLow ? *gainLowParameter : *gainHighParameter;
+            setParameterValue(parameter, parameter.convertTo0to1(command.value));
+            fadeEngine.setRange(gainLow->load(), gainHigh->load());
+            return;
+        }
+
+        default:
+            break;
+    }
+
+    // Durations in beats or bars are converted at the current tempo, and
+    // again whenever it changes
+    const auto unit = command.durationInSeconds ? TransportSync::Seconds : (TransportSync::Unit) (int) durationUnit->load();
+    const double quarterNotes = transport.toQuarterNotes(unit, command.duration);
+    const double samples = unit == TransportSync::Seconds ? command.duration * sampleRate : quarterNotes * transport.getSamplesPerBeat();
+
+    fadeEngine.start(command.target, samples, command.channels, unit == TransportSync::Seconds ? 0.0 : quarterNotes, command.elapsed);
+}
+
+bool FaderVSTAudioProcessor::scheduleFade(const FadeCommand &command, int offset, int numSamples){
+    const auto start = (TransportSync::Start) (int) syncStart->load();
+    if (! command.quantisable || start == TransportSync::Immediately || ! transport.isPlaying()){
+        return false;
+    }
+
+    // The start is converted to samples once here, and only again if the
+    // tempo changes or the transport jumps before it is reached
+    scheduledStart = start;
+    scheduledPosition = transport.getNextGridPosition(start, transport.getPosition(offset));
+    scheduledFade = command;
+    scheduledFade.quantisable = false;
+    // Every member waits for the same point of the grid, so nothing is late
+    scheduledFade.elapsed = 0;
+    scheduledFade.timestamp = sampleClock + juce::jmax((juce::int64) offset, (juce::int64) std::llround(transport.getOffset(scheduledPosition)));
+
+    // A later command replaces one still waiting for its turn
+    fadeScheduled = scheduledFade.timestamp >= sampleClock + numSamples;
+    if (! fadeScheduled){
+        addBlockCommand(scheduledFade);
+    }
+
+    return true;
+}
+
+void FaderVSTAudioProcessor::rescheduleFade(){
+    // While the transport is stopped, the fade starts at the sample it was
+    // last converted to
+    if (! transport.isPlaying()) return;
+
+    // After a jump (e.g. when a loop wraps around) the original position may
+    // have been skipped or lie far ahead, so move to the next point of the
+    // grid from here instead
+    const double position = transport.getPosition(0);
+    if (scheduledPosition < position || scheduledPosition - position > transport.getGridLength(scheduledStart)){
+        scheduledPosition = transport.getNextGridPosition(scheduledStart, position);
+    }
+
+    scheduledFade.timestamp = sampleClock + juce::jmax((juce::int64) 0, (juce::int64) std::llround(transport.getOffset(scheduledPosition)));
+}
+
+void FaderVSTAudioProcessor::addBlockCommand(const FadeCommand &command){
+    if (numBlockCommands == maxBlockCommands) return;
+
+    // Insert the command after all the ones with the same or an earlier
+    // timestamp
+    int index = numBlockCommands;
+    while (index > 0 && blockCommands[(size_t) (index - 1)].timestamp > command.timestamp){
+        blockCommands[(size_t) index] = blockCommands[(size_t) (index - 1)];
+        --index;
+    }
+
+    blockCommands[(size_t) index] = command;
+    ++numBlockCommands;
+}
+
+void FaderVSTAudioProcessor::handleMidi(const juce::MidiBuffer &midiMessages){
+    for (const auto metadata : midiMessages){
+        const auto trigger = MidiTrigger::fromMessage(metadata.getMessage());
+        if (trigger.kind == MidiTrigger::None) continue;
+
+        // While learning, the first trigger is handed to the message thread
+        // instead of fading
+        if (learningMidi.exchange(false)){
+            learnedMidiTrigger.store(trigger.pack());
+            continue;
+        }
+
+        MidiMapping mapping;
+        if (midiMappings.find(trigger, mapping)){
+            // In a fade group, the message is delayed by a block so that the
+            // members that have already processed this one follow it too
+            if (auto *group = groupMember.getGroup()){
+                group->trigger(mapping.action, mapping.duration, group->getDelayedStart(groupMember.getTime() + metadata.samplePosition));
+            } else {
+                addBlockCommand({ mapping.action, mapping.duration, sampleClock + metadata.samplePosition });
+            }
+        }
+    }
+}
+
+void FaderVSTAudioProcessor::handleRemoteCommands(){
+    RemoteCommand remote;
+    while (numBlockCommands < maxBlockCommands && remoteCommands.pop(remote)){
+        oscLatency.record(juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - remote.receivedTicks) * 1000.0);
+
+        if (remote.kind == RemoteCommand::Range){
+            // The parameters are changed on the message thread, so that the
+            // host and the editor follow, by applyRequestedRange()
+            requestedRangeLow = remote.low;
+            requestedRangeHigh = remote.high;
+            continue;
+        }
+
+        // The durations of the messages are in seconds. Without one, fade
+        // like the button of the editor would.
+        double duration = remote.duration;
+        const bool durationInSeconds = ! std::isnan(duration);
+        if (! durationInSeconds){
+            const bool down = remote.target == FadeCommand::Down || (remote.target == FadeCommand::Toggle && fadeEngine.getDirection() >= 0.5f);
+            duration = down ? fadeDownTime.load() : fadeUpTime.load();
+        }
+
+        if (remote.group > 0){
+            auto &group = FadeGroups::get(remote.group);
+            group.trigger(remote.target, duration, group.getNextBlockStart(), durationInSeconds);
         } else {
-            // Set the gain to the high point instantly
-            *gain = gainHigh->load();
+            FadeCommand command { remote.target, duration, sampleClock, true, durationInSeconds };
+            command.channels = remote.channels;
+            addBlockCommand(command);
         }
+    }
+}
 
-        buffer.applyGain(*gain);
+bool FaderVSTAudioProcessor::setOscPort(int port){
+    oscPort = juce::jmax(0, port);
+    return oscRemote.listen(oscPort);
+}
 
-        // Notify the host of the new gain value
-        parameters.getParameter("gain")->setValueNotifyingHost(*gain);
+void FaderVSTAudioProcessor::triggerFade(FadeCommand::Target target, double duration, juce::uint32 channels){
+    const int groupId = (int) fadeGroup->load();
+    if (groupId > 0 && channels == 0){
+        auto &group = FadeGroups::get(groupId);
+        group.trigger(target, duration, group.getNextBlockStart());
+    } else {
+        FadeCommand command { target, duration, getSampleClock() };
+        command.channels = channels;
+        postFadeCommand(command);
+    }
+}
 
+template <typename SampleType>
+void FaderVSTAudioProcessor::handleSidechain(juce::AudioBuffer<SampleType> &buffer){
+    const bool ducking = duck->load() >= 0.5f && getBusCount(true) > 1 && getBus(true, 1)->isEnabled();
+    if (! ducking){
+        // Release the audio if it was ducked when the mode was turned off,
+        // since nothing else would fade it back up
+        if (ducker.isDucked()){
+            addBlockCommand({ FadeCommand::Up, duckRelease->load() * 0.001, sampleClock, false, true });
+        }
+        ducker.reset();
         return;
+    }
+
+    const auto sidechain = getBusBuffer(buffer, true, 1);
+    ducker.setParameters(
+        juce::Decibels::decibelsToGain(duckThreshold->load()),
+        (juce::int64) (duckHold->load() * 0.001 * sampleRate)
+    );
+
+    // The fades start on the exact sample where the sidechain crosses the
+    // threshold, so they are never moved to the grid
+    ducker.process(sidechain.getArrayOfReadPointers(), sidechain.getNumChannels(), sidechain.getNumSamples(), [this](FadeCommand::Target target, int offset){
+        const double duration = (target == FadeCommand::Down ? duckAttack : duckRelease)->load() * 0.001;
+        addBlockCommand({ target, duration, sampleClock + offset, false, true });
+    });
+}
+
+void FaderVSTAudioProcessor::setCues(std::vector<Cue> cues){
+    cueList.setCues(std::move(cues));
+}
+
+void FaderVSTAudioProcessor::learnMidiMapping(int slot, FadeCommand::Target action, double duration){
+    learnSlot = slot;
+    learnAction = action;
+    learnDuration = duration;
+    learnedMidiTrigger = 0;
+    learningMidi = true;
+}
+
+void FaderVSTAudioProcessor::cancelMidiLearn(){
+    learningMidi = false;
+    learnSlot = -1;
+}
+
+void FaderVSTAudioProcessor::finishMidiLearn(){
+    const auto packedTrigger = learnedMidiTrigger.exchange(0);
+    if (packedTrigger == 0 || learnSlot < 0) return;
+
+    MidiMapping mapping;
+    mapping.trigger = MidiTrigger::unpack(packedTrigger);
+    mapping.action = learnAction;
+    mapping.duration = learnDuration;
+
+    // A trigger can only be mapped to one fade
+    for (int slot = 0; slot < MidiMappings::size; ++slot){
+        if (midiMappings.get(slot).trigger == mapping.trigger){
+            midiMappings.clear(slot);
+        }
+    }
+
+    midiMappings.set(learnSlot, mapping);
+    learnSlot = -1;
+}
+
+int FaderVSTAudioProcessor::getSmoothingSamples() const {
+    return (int) (smoothingTime->load() * 0.001 * sampleRate);
+}
+
+void FaderVSTAudioProcessor::setParameterValue(juce::RangedAudioParameter &parameter, float value){
+    parameter.setValue(value);
+    parameter.sendValueChangedMessageToListeners(value);
+}
+
+FadeEngine::Parameters FaderVSTAudioProcessor::getFadeParameters() const {
+    return { gainLow->load(), gainHigh->load(), (FadeCurve::Shape) (int) curve->load(), getSmoothingSamples() };
+}
+
+template <typename SampleType>
+void FaderVSTAudioProcessor::processSegment(juce::AudioBuffer<SampleType> &buffer, const juce::AudioBuffer<SampleType> *inputB, int startSample, int numSamples){
+    if (numSamples <= 0) return;
+
+    // Mixes the B input in with mix(). The levels are measured in separate
+    // passes, since the output is no longer the input times the gain.
+    const auto applyCrossfade = [&](int start, int count, auto &&mix){
+        if (metering){
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel){
+                LevelMeter::measure(buffer.getReadPointer(channel, start), count, inputLevels);
+            }
+        }
+
+        mix();
+
+        if (metering){
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel){
+                LevelMeter::measure(buffer.getReadPointer(channel, start), count, outputLevels);
+            }
+        }
     };
 
-    /** How many samples remain until the fading ends */
-    int remaining;
-    if (*fading < 0.5){
-        // Going down
-        remaining = (*gain - *gainLow) / (*gainHigh - *gainLow) * fadeDuration;
-    } else {
-        // Going up
-        remaining = (*gainHigh - *gain) / (*gainHigh - *gainLow) * fadeDuration;
+    // The B input follows the position of the gain inside the range, so
+    // that it is silent at the high gain and at full level at the low gain.
+    // The range is settled while the gains are constant, and the ramps come
+    // with the range at each sample.
+    const auto getRangeLow = [&]{ return (SampleType) fadeEngine.getLow(); };
+    const auto getRangeWidth = [&]{ return (SampleType) fadeEngine.getHigh() - (SampleType) fadeEngine.getLow(); };
+
+    // Applies a constant gain to a run of channels
+    const auto applyChannelsGain = [&](int firstChannel, int numChannels, float gain, int start, int count){
+        if (gain == 1.0f){
+            // At unity the audio passes through untouched
+            if (metering){
+                LevelMeter::Levels levels;
+                for (int channel = firstChannel; channel < firstChannel + numChannels; ++channel){
+                    LevelMeter::measure(buffer.getReadPointer(channel, start), count, levels);
+                }
+                inputLevels.add(levels);
+                outputLevels.add(levels);
+            }
+        } else if (gain == 0.0f){
+            // Silence the audio, marking the buffer as clear when the whole
+            // of it is silenced
+            if (metering){
+                for (int channel = firstChannel; channel < firstChannel + numChannels; ++channel){
+                    LevelMeter::measure(buffer.getReadPointer(channel, start), count, inputLevels);
+                }
+                outputLevels.numSamples += (juce::int64) count * numChannels;
+            }
+            if (numChannels == buffer.getNumChannels() && start == 0 && count == buffer.getNumSamples()){
+                buffer.clear();
+            } else {
+                for (int channel = firstChannel; channel < firstChannel + numChannels; ++channel){
+                    buffer.clear(channel, start, count);
+                }
+            }
+        } else if (metering){
+            LevelMeter::applyGain(buffer.getArrayOfWritePointers() + firstChannel, numChannels, start, (SampleType) gain, count, inputLevels, outputLevels);
+        } else {
+            GainKernel::applyGain(buffer.getArrayOfWritePointers() + firstChannel, numChannels, start, (SampleType) gain, count);
+        }
+    };
+
+    const auto applyConstantGains = [&](const float *gains, int numGains, int offset, int count){
+        const int start = startSample + offset;
+        const int numChannels = buffer.getNumChannels();
+
+        bool crossfading = false;
+        if (inputB != nullptr){
+            for (int lane = 0; lane < numGains; ++lane){
+                crossfading = crossfading || GainKernel::getCrossfadeGain((SampleType) gains[lane], getRangeLow(), getRangeWidth()) != (SampleType) 0;
+            }
+        }
+
+        if (crossfading){
+            applyCrossfade(start, count, [&]{
+                GainKernel::crossfade(buffer.getArrayOfWritePointers(), numChannels, inputB->getArrayOfReadPointers(), inputB->getNumChannels(), start,
+                                      gains, numGains, getRangeLow(), getRangeWidth(), count);
+            });
+            return;
+        }
+
+        // Each lane is applied on its own, so that the channels at unity are
+        // skipped and the silent ones cleared. The channels past the last
+        // lane share its gain.
+        for (int lane = 0; lane < numGains && lane < numChannels; ++lane){
+            const int laneChannels = lane == numGains - 1 ? numChannels - lane : 1;
+            applyChannelsGain(lane, laneChannels, gains[lane], start, count);
+        }
+    };
+
+    // The gains are handed over a chunk at a time, and multiplied with each
+    // channel while the chunk is still in the cache
+    const auto applyGains = [&](const SampleType *const *gains, int numGains, const SampleType *lows, const SampleType *ranges, int offset, int count){
+        const int start = startSample + offset;
+
+        if (inputB != nullptr){
+            applyCrossfade(start, count, [&]{
+                GainKernel::crossfade(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), inputB->getArrayOfReadPointers(), inputB->getNumChannels(), start,
+                                      gains, numGains, lows, ranges, count);
+            });
+        } else if (metering){
+            // The levels are measured in the same pass that applies the gains
+            LevelMeter::applyGains(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, gains, numGains, count, inputLevels, outputLevels);
+        } else {
+            GainKernel::applyGains(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, gains, numGains, count);
+        }
+    };
+
+    fadeEngine.process<SampleType>(numSamples, applyConstantGains, applyGains);
+}
+
+void FaderVSTAudioProcessor::parameterChanged(const juce::String &parameterID, float newValue){
+    // Ignore the change caused by reporting the telemetry, which is made on
+    // the message thread, but not the changes made meanwhile by other threads
+    if (juce::MessageManager::existsAndIsCurrentThread() && reportingParameter != nullptr && parameterID == reportingParameter) return;
+
+    // Hand the new value over to the audio thread
+    if (parameterID == "gain"){
+        requestedGain = newValue;
+    } else if (parameterID == "fading"){
+        requestedFading = newValue;
     }
+}
 
-    // If the remaining samples are negative, that means that the end point
-    // was moved past the current gain value while the audio was fading.
-    // In that case, set the remaining samples to 0 to not crash the
-    // processing.
-    if (remaining < 0) remaining = 0;
+void FaderVSTAudioProcessor::timerCallback(){
+    cueList.update();
+    finishMidiLearn();
+    applyRequestedRange();
+    reportRecalledProgram();
+    reportTelemetry();
+}
 
-    /** How many samples to process in the current block */
-    int samplesToProcess = juce::jmin(remaining, buffer.getNumSamples());
-    /** The gain at the end of the block */
-    float finalGain;
+void FaderVSTAudioProcessor::applyRequestedRange(){
+    // The high end is written last, so the low end is there once it is
+    if (std::isnan(requestedRangeHigh.load())) return;
 
-    float gainStep = (*gainHigh - *gainLow) / fadeDuration * samplesToProcess;
-    if (*fading < 0.5){
-        // Going down
-        finalGain = *gain - gainStep;
-    } else {
-        // Going up
-        finalGain = *gain + gainStep;
+    const float high = requestedRangeHigh.exchange(std::numeric_limits<float>::quiet_NaN());
+    const float low = requestedRangeLow.exchange(std::numeric_limits<float>::quiet_NaN());
+
+    gainLowParameter->setValueNotifyingHost(gainLowParameter->convertTo0to1(low));
+    gainHighParameter->setValueNotifyingHost(gainHighParameter->convertTo0to1(high));
+}
+
+void FaderVSTAudioProcessor::reportRecalledProgram(){
+    if (recalledProgram.exchange(-1) < 0) return;
+
+    for (const auto *parameterID : programParameterIDs){
+        auto *param = parameters.getParameter(parameterID);
+        param->setValueNotifyingHost(param->convertTo0to1(parameters.getRawParameterValue(parameterID)->load()));
     }
 
-    // Apply the gain ramp
-    buffer.applyGainRamp(0, samplesToProcess, *gain, finalGain);
+    updateHostDisplay(ChangeDetails().withProgramChanged(true));
+}
+
+void FaderVSTAudioProcessor::reportTelemetry(){
+    const auto snapshot = telemetry.read();
+    if (snapshot == reportedTelemetry) return;
 
-    // If any samples remain after the ramp, apply a constant gain
-    if (samplesToProcess < buffer.getNumSamples()){
-        buffer.applyGain(samplesToProcess, buffer.getNumSamples() - samplesToProcess, finalGain);
-        // Since the fading has ended, set the duration to 0 so that next
-        // blocks are processed with a constant gain directly
-        fadeDuration = 0;
+    const auto report = [this](const char *parameterID, float value){
+        auto *param = parameters.getParameter(parameterID);
+        reportingParameter = parameterID;
+        param->setValueNotifyingHost(param->convertTo0to1(value));
+        reportingParameter = nullptr;
+    };
+
+    if (snapshot.gain != reportedTelemetry.gain){
+        report("gain", snapshot.gain);
+        // Also update the gain directly because the above method does not update the value if the difference is too small
+        *gain = snapshot.gain;
+    }
+
+    if (snapshot.fading != reportedTelemetry.fading){
+        report("fading", snapshot.fading);
     }
 
-    // Notify the editor that the parameter has changed so it can update the GUI
-    parameters.getParameter("gain")->setValueNotifyingHost(finalGain);
-    // Also update the gain directly because the above method does not update the value if the difference is too small
-    *gain = finalGain;
+    reportedTelemetry = snapshot;
 }
 
 bool FaderVSTAudioProcessor::hasEditor() const {
@@ -220,15 +778,170 @@ juce::AudioProcessorEditor* FaderVSTAudioProcessor::createEditor(){
     return new FaderVSTAudioProcessorEditor (*this, parameters);
 }
 
+/** Identifies the state of the plugin ("FDVS"). */
+static constexpr int stateMagic = 0x53564446;
+
+/** The version of the state format written by getStateInformation(). */
+static constexpr int stateVersion = 3;
+
 void FaderVSTAudioProcessor::getStateInformation (juce::MemoryBlock& destData){
-    // You should use this method to store your parameters in the memory block.
-    // You could do that either as raw data, or use the XML or ValueTree classes
-    // as intermediaries to make it easy to save and load complex data.
+    // The state is stored in a compact binary format, which is read back in
+    // the same order by setStateInformation()
+    juce::MemoryOutputStream stream(destData, false);
+    stream.writeInt(stateMagic);
+    stream.writeInt(stateVersion);
+
+    // The parameters, as IDs and values, so that they can be matched by ID
+    // when parameters are added
+    const auto &params = getParameters();
+    stream.writeCompressedInt(params.size());
+    for (auto *param : params){
+        const auto *ranged = dynamic_cast<juce::RangedAudioParameter*>(param);
+        stream.writeString(ranged->paramID);
+        stream.writeFloat(parameters.getRawParameterValue(ranged->paramID)->load());
+    }
+
+    // The settings of the editor
+    stream.writeDouble(fadeDownTime);
+    stream.writeDouble(fadeUpTime);
+    stream.writeBool(keyboardShortcutEnabled);
+    stream.writeInt(keyboardShortcut.getKeyCode());
+    stream.writeInt(keyboardShortcut.getModifiers().getRawFlags());
+    stream.writeInt((int) keyboardShortcut.getTextCharacter());
+
+    // The MIDI mappings
+    stream.writeCompressedInt(MidiMappings::size);
+    for (int slot = 0; slot < MidiMappings::size; ++slot){
+        const auto mapping = midiMappings.get(slot);
+        stream.writeInt((int) mapping.trigger.pack());
+        stream.writeByte((char) mapping.action);
+        stream.writeDouble(mapping.duration);
+    }
+
+    // The cues
+    const auto &cues = cueList.getCues();
+    stream.writeCompressedInt((int) cues.size());
+    for (const auto &cue : cues){
+        stream.writeDouble(cue.time);
+        stream.writeByte((char) cue.target);
+        stream.writeDouble(cue.duration);
+    }
+
+    // The preset bank, with the IDs of the parameters it stores
+    stream.writeCompressedInt(currentProgram);
+    stream.writeCompressedInt((int) programParameterIDs.size());
+    for (const auto *parameterID : programParameterIDs){
+        stream.writeString(parameterID);
+    }
+    stream.writeCompressedInt(numPrograms);
+    for (const auto &program : programs){
+        stream.writeString(program.name);
+        for (const auto &value : program.values){
+            stream.writeFloat(value);
+        }
+        stream.writeDouble(program.fadeDownTime);
+        stream.writeDouble(program.fadeUpTime);
+    }
+
+    // The OSC port is not saved, since only one instance can listen on it,
+    // and a copy of the state (e.g. of a duplicated track) would fail to
+    // bind. Version 2 saved it here.
 }
 
 void FaderVSTAudioProcessor::setStateInformation (const void* data, int sizeInBytes){
-    // You should use this method to restore your parameters from this memory block,
-    // whose contents will have been created by the getStateInformation() call.
+    juce::MemoryInputStream stream(data, (size_t) sizeInBytes, false);
+
+    if (stream.readInt() != stateMagic) return;
+
+    const int version = stream.readInt();
+    if (version < 1 || version > stateVersion) return;
+
+    // Reading past the end of the stream returns zeroes, so a truncated
+    // state cannot make any of the loops below run away
+    const int numParameters = stream.readCompressedInt();
+    for (int i = 0; i < numParameters && ! stream.isExhausted(); ++i){
+        const auto parameterID = stream.readString();
+        const float value = stream.readFloat();
+        if (auto *param = parameters.getParameter(parameterID)){
+            param->setValueNotifyingHost(param->convertTo0to1(value));
+        }
+    }
+
+    fadeDownTime = stream.readDouble();
+    fadeUpTime = stream.readDouble();
+    keyboardShortcutEnabled = stream.readBool();
+    const int keyCode = stream.readInt();
+    const int modifiers = stream.readInt();
+    const auto textCharacter = (juce::juce_wchar) stream.readInt();
+    keyboardShortcut = juce::KeyPress(keyCode, juce::ModifierKeys(modifiers), textCharacter);
+
+    const int numMappings = stream.readCompressedInt();
+    for (int slot = 0; slot < numMappings && ! stream.isExhausted(); ++slot){
+        MidiMapping mapping;
+        mapping.trigger = MidiTrigger::unpack((juce::uint32) stream.readInt());
+        mapping.action = (FadeCommand::Target) juce::jlimit(0, (int) FadeCommand::Stop, (int) stream.readByte());
+        mapping.duration = stream.readDouble();
+        if (slot < MidiMappings::size){
+            midiMappings.set(slot, mapping);
+        }
+    }
+
+    const int numCues = stream.readCompressedInt();
+    std::vector<Cue> cues;
+    for (int i = 0; i < numCues && ! stream.isExhausted(); ++i){
+        Cue cue;
+        cue.time = stream.readDouble();
+        cue.target = (FadeCommand::Target) juce::jlimit(0, (int) FadeCommand::Stop, (int) stream.readByte());
+        cue.duration = stream.readDouble();
+        cues.push_back(cue);
+    }
+    setCues(std::move(cues));
+
+    const int program = stream.readCompressedInt();
+    if (juce::isPositiveAndBelow(program, numPrograms)){
+        currentProgram = program;
+    }
+
+    // Match the parameters of the programs to the ones that still exist
+    const int numProgramParameters = stream.readCompressedInt();
+    std::vector<int> parameterIndices;
+    for (int i = 0; i < numProgramParameters && ! stream.isExhausted(); ++i){
+        const auto parameterID = stream.readString();
+        const auto found = std::find_if(programParameterIDs.begin(), programParameterIDs.end(), [&](const char *id){
+            return parameterID == id;
+        });
+        parameterIndices.push_back(found == programParameterIDs.end() ? -1 : (int) std::distance(programParameterIDs.begin(), found));
+    }
+
+    const int numStoredPrograms = stream.readCompressedInt();
+    for (int index = 0; index < numStoredPrograms && ! stream.isExhausted(); ++index){
+        const auto name = stream.readString();
+        std::array<float, programParameterIDs.size()> values;
+        for (size_t i = 0; i < values.size(); ++i){
+            values[i] = programs[(size_t) juce::jmin(index, numPrograms - 1)].values[i];
+        }
+        for (const int parameterIndex : parameterIndices){
+            const float value = stream.readFloat();
+            if (parameterIndex >= 0){
+                values[(size_t) parameterIndex] = value;
+            }
+        }
+        const double programFadeDownTime = stream.readDouble();
+        const double programFadeUpTime = stream.readDouble();
+
+        if (index < numPrograms){
+            auto &stored = programs[(size_t) index];
+            stored.name = name;
+            for (size_t i = 0; i < values.size(); ++i){
+                stored.values[i] = values[i];
+            }
+            stored.fadeDownTime = programFadeDownTime;
+            stored.fadeUpTime = programFadeUpTime;
+        }
+    }
+
+    // The OSC port of a version 2 state is ignored, so that the instance
+    // keeps listening where it was
 }
 
 // This creates new instances of the plugin..
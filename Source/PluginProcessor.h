@@ -20,11 +20,27 @@
 
 #pragma once
 #include <juce_audio_processors/juce_audio_processors.h>
+#include "CpuLoadMeter.h"
+#include "CueList.h"
+#include "FadeCommandQueue.h"
+#include "FadeCurve.h"
+#include "FadeEngine.h"
+#include "FadeGroups.h"
+#include "GainKernel.h"
+#include "LevelMeter.h"
+#include "MidiMappings.h"
+#include "OscRemote.h"
+#include "GainTelemetry.h"
+#include "SidechainDucker.h"
+#include "TransportSync.h"
+#include <vector>
 
 class FaderVSTAudioProcessor  : public juce::AudioProcessor
                             #if JucePlugin_Enable_ARA
                              , public juce::AudioProcessorARAExtension
                             #endif
+                             , private juce::AudioProcessorValueTreeState::Listener
+                             , private juce::Timer
 {
 public:
     FaderVSTAudioProcessor();
@@ -38,6 +54,9 @@ public:
     #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+
+    bool supportsDoublePrecisionProcessing() const override;
 
     juce::AudioProcessorEditor* createEditor() override;
     bool hasEditor() const override;
@@ -58,20 +77,83 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
-    void fade(double seconds){
-        // Invert the fading direction
-        *fading = 1.0 - *fading;
-        fadeDuration = seconds * sampleRate;
+    /** The number of programs in the preset bank. */
+    static constexpr int numPrograms = 8;
+
+    /**
+     * Stores the current settings in a program of the preset bank.
+     *
+     * Must be called from the message thread.
+     */
+    void storeProgram(int index);
+
+    /*
+     * The settings below are used by the editor, but are kept in the
+     * processor so that they are saved with the rest of the state. Only the
+     * fade times are changed by recalling a program, which may happen on the
+     * audio thread.
+     */
+
+    double getFadeDownTime() const {
+        return fadeDownTime.load();
+    }
+
+    void setFadeDownTime(double duration){
+        fadeDownTime = duration;
+    }
+
+    double getFadeUpTime() const {
+        return fadeUpTime.load();
+    }
+
+    void setFadeUpTime(double duration){
+        fadeUpTime = duration;
+    }
+
+    const juce::KeyPress& getKeyboardShortcut() const {
+        return keyboardShortcut;
+    }
+
+    void setKeyboardShortcut(const juce::KeyPress &key){
+        keyboardShortcut = key;
     }
 
-    void fadeDown(double seconds){
-        *fading = 0.0;
-        fadeDuration = seconds * sampleRate;
+    bool isKeyboardShortcutEnabled() const {
+        return keyboardShortcutEnabled;
     }
 
-    void fadeUp(double seconds){
-        *fading = 1.0;
-        fadeDuration = seconds * sampleRate;
+    void setKeyboardShortcutEnabled(bool enabled){
+        keyboardShortcutEnabled = enabled;
+    }
+
+    /*
+     * The fading controls below only queue a command for the audio thread,
+     * which applies it at the start of its next block. They may only be
+     * called from a single thread (normally the message thread).
+     *
+     * In a fade group, the command is sent to every member of the group
+     * instead, and takes effect on all of them in the block after the one
+     * being processed.
+     *
+     * The durations are in the unit chosen by the "durationUnit" parameter,
+     * and the fades may be moved to the next beat or bar by the "syncStart"
+     * parameter.
+     *
+     * The channels to fade can be given as a mask with a bit per channel,
+     * and the others keep their own fades. Fades of some of the channels
+     * are not sent to the fade group.
+     */
+
+    void fade(double duration, juce::uint32 channels = 0){
+        triggerFade(FadeCommand::Toggle, duration, channels);
+    }
+
+    void fadeDown(double duration, juce::uint32 channels = 0){
+        triggerFade(FadeCommand::Down, duration, channels);
+    }
+
+    void fadeUp(double duration, juce::uint32 channels = 0){
+        triggerFade(FadeCommand::Up, duration, channels);
     }
 
     void setGainRange(float low, float high){
@@ -79,8 +161,146 @@ public:
         *gainHigh = high;
     }
 
-    void stopFading(){
-        fadeDuration = 0;
+    void stopFading(juce::uint32 channels = 0){
+        triggerFade(FadeCommand::Stop, 0.0, channels);
+    }
+
+    /**
+     * Queues a fade command to be applied by the audio thread at the sample
+     * given by its timestamp.
+     *
+     * Returns false if the command could not be queued.
+     */
+    bool postFadeCommand(const FadeCommand &command){
+        return fadeCommands.push(command);
+    }
+
+    /**
+     * Returns the current position of the sample clock used for the
+     * timestamps of fade commands, which is the first sample of the block
+     * that will be processed next.
+     */
+    juce::int64 getSampleClock() const {
+        return publishedSampleClock.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Returns the MIDI mappings that trigger fades.
+     */
+    MidiMappings& getMidiMappings(){
+        return midiMappings;
+    }
+
+    /**
+     * Starts listening for a MIDI message, which will then be mapped to the
+     * given fade in a slot of the MIDI mappings.
+     *
+     * Must be called from the message thread.
+     */
+    void learnMidiMapping(int slot, FadeCommand::Target action, double duration);
+
+    /**
+     * Stops listening for a MIDI message to map.
+     */
+    void cancelMidiLearn();
+
+    /**
+     * Returns true while listening for a MIDI message to map.
+     */
+    bool isLearningMidi() const {
+        return learnSlot >= 0;
+    }
+
+    /**
+     * Replaces the cue list, which is saved with the state of the plugin and
+     * played back while the transport of the host is rolling.
+     *
+     * Must be called from the message thread.
+     */
+    void setCues(std::vector<Cue> cues);
+
+    /**
+     * Returns the cue list, in order.
+     */
+    const std::vector<Cue>& getCues() const {
+        return cueList.getCues();
+    }
+
+    /**
+     * Starts listening for OSC messages on a port of the loopback interface,
+     * or stops if the port is 0. The port is not saved with the state, so
+     * that copies of an instance do not try to listen on the same port.
+     *
+     * Returns false if the port cannot be used, in which case the port is
+     * kept but isOscListening() returns false. Must be called from the
+     * message thread.
+     */
+    bool setOscPort(int port);
+
+    /** Returns the port set with setOscPort(). */
+    int getOscPort() const {
+        return oscPort;
+    }
+
+    /** Returns true if OSC messages are being received. */
+    bool isOscListening() const {
+        return oscRemote.getPort() != 0;
+    }
+
+    /**
+     * Returns the statistics of the time between receiving an OSC message
+     * and the audio thread acting on it.
+     */
+    RemoteLatency::Stats getOscLatency() const {
+        return oscLatency.getStats();
+    }
+
+    /**
+     * Returns the number of OSC messages dropped because the audio thread
+     * had not taken the earlier ones yet.
+     */
+    int getOscNumDropped() const {
+        return oscRemote.getNumDropped();
+    }
+
+   #if FADERVST_CPU_METER
+    /**
+     * Returns the statistics of the time taken by processBlock.
+     */
+    CpuLoadMeter::Stats getCpuLoad() const {
+        return cpuLoadMeter.getStats();
+    }
+
+    /**
+     * Starts measuring the time taken by processBlock from scratch.
+     */
+    void resetCpuLoad(){
+        cpuLoadMeter.reset();
+    }
+   #endif
+
+    /**
+     * Turns the measuring of the input and output levels on or off. They are
+     * only measured while an editor shows them.
+     */
+    void setMeteringEnabled(bool enabled){
+        meteringEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    /**
+     * Takes the levels measured since the last call, combined into one
+     * reading. Returns false if no blocks were measured.
+     */
+    bool popLevels(LevelMeter::Reading &reading){
+        return levelReadings.pop(reading);
+    }
+
+    /**
+     * Sets how many times per second the gain and fading state computed by
+     * the audio thread is reported to the host and the editor.
+     */
+    void setTelemetryRate(int hz){
+        startTimerHz(hz);
     }
 
 private:
@@ -97,8 +317,15 @@ private:
     /** The value of the gain when normal. */
     std::atomic<float> *gainHigh;
 
+    /** The parameters of gainLow and gainHigh, for setting them at a sample. */
+    juce::RangedAudioParameter *gainLowParameter;
+    juce::RangedAudioParameter *gainHighParameter;
+
     /**
-     * The current value of the gain.
+     * The current value of the gain, as reported to the host.
+     *
+     * The audio thread keeps the gain it is actually applying in fadeEngine,
+     * and it is copied here periodically by timerCallback().
      */
     std::atomic<float> *gain;
 
@@ -109,11 +336,336 @@ private:
      * means it should be fading upwards.
      * After the fading has ended, the value stays the same, so 0.0 means faded to
      * the low gain and 1.0 faded to the high gain.
+     *
+     * Like gain, this is only a report of the direction of fadeEngine.
      */
     std::atomic<float> *fading;
 
-    /** The total duration of the current fade (in samples). */
-    int fadeDuration;
+    /** The shape of the fades, as a FadeCurve::Shape. */
+    std::atomic<float> *curve;
+
+    /**
+     * How long gainLow, gainHigh and manual changes of the gain take to glide
+     * to their new values (in milliseconds).
+     */
+    std::atomic<float> *smoothingTime;
+
+    /** Where the fades start, as a TransportSync::Start. */
+    std::atomic<float> *syncStart;
+
+    /** The unit of the durations of the fades, as a TransportSync::Unit. */
+    std::atomic<float> *durationUnit;
+
+    /** The fade group of the instance, or 0 if it is in none. */
+    std::atomic<float> *fadeGroup;
+
+    /**
+     * The membership of the fade group. Only accessed by the audio thread.
+     */
+    FadeGroupMember groupMember;
+
+    /** Whether the fades are driven by the level of the sidechain. */
+    std::atomic<float> *duck;
+
+    /** The level of the sidechain that ducks the audio (in dB). */
+    std::atomic<float> *duckThreshold;
+
+    /** The durations of the fades down and up when ducking (in milliseconds). */
+    std::atomic<float> *duckAttack;
+    std::atomic<float> *duckRelease;
+
+    /**
+     * How long the audio stays ducked after the sidechain falls below the
+     * threshold (in milliseconds).
+     */
+    std::atomic<float> *duckHold;
+
+    /** Follows the level of the sidechain. Only accessed by the audio thread. */
+    SidechainDucker ducker;
+
+    /**
+     * Whether the fades crossfade between the main input (A) and the second
+     * input (B), instead of fading the main input alone.
+     */
+    std::atomic<float> *crossfade;
+
+    /**
+     * The state of the fading, and the gains it applies. Only accessed by
+     * the audio thread.
+     */
+    FadeEngine fadeEngine;
+
+    /**
+     * A value set to the gain parameter from outside of the processor (e.g.
+     * by host automation) that the audio thread has not picked up yet, or NaN
+     * if there is none.
+     */
+    std::atomic<float> requestedGain;
+
+    /**
+     * A value set to the fading parameter from outside of the processor that
+     * the audio thread has not picked up yet, or NaN if there is none.
+     */
+    std::atomic<float> requestedFading;
+
+    /**
+     * A gain range received over OSC that the message thread has not applied
+     * yet, or NaN if there is none.
+     */
+    std::atomic<float> requestedRangeLow;
+    std::atomic<float> requestedRangeHigh;
+
+    /** The gain and fading state, published by the audio thread. */
+    GainTelemetry telemetry;
+
+    /** The last snapshot of the telemetry that was reported to the host. */
+    GainTelemetry::Snapshot reportedTelemetry;
+
+    /**
+     * The ID of the parameter whose telemetry is being reported to the host,
+     * or nullptr, so that the resulting change is not mistaken for an outside
+     * change. Only accessed by the message thread.
+     */
+    const char *reportingParameter = nullptr;
+
+    /** The transport of the host. Only accessed by the audio thread. */
+    TransportSync transport;
+
+    /**
+     * A command waiting for its beat or bar in a later block, with its
+     * timestamp already converted to samples.
+     *
+     * Only accessed by the audio thread, like the fields below.
+     */
+    FadeCommand scheduledFade;
+    /** Whether scheduledFade is waiting. */
+    bool fadeScheduled = false;
+    /** The grid that scheduledFade was moved to. */
+    TransportSync::Start scheduledStart = TransportSync::Immediately;
+    /** The position scheduledFade starts at, in quarter notes. */
+    double scheduledPosition = 0.0;
+
+    /** The fade commands waiting to be applied by the audio thread. */
+    FadeCommandQueue fadeCommands;
+
+    /**
+     * The index of the first sample of the block being processed.
+     *
+     * Only accessed by the audio thread.
+     */
+    juce::int64 sampleClock = 0;
+
+    /** The duration of the fades started by the editor. */
+    std::atomic<double> fadeDownTime { 1.0 };
+    std::atomic<double> fadeUpTime { 1.0 };
+
+    /** The key that starts a fade while the editor has the focus. */
+    juce::KeyPress keyboardShortcut;
+    bool keyboardShortcutEnabled = false;
+
+    /** The IDs of the parameters that are stored in programs. */
+    static constexpr std::array<const char*, 11> programParameterIDs {
+        "gainLow", "gainHigh", "curve", "smoothing", "syncStart", "durationUnit",
+        "duck", "duckThreshold", "duckAttack", "duckHold", "duckRelease"
+    };
+
+    /** The values of the parameters in programParameterIDs. */
+    std::array<std::atomic<float>*, programParameterIDs.size()> programParameters;
+
+    /**
+     * A preallocated snapshot of the settings, which can be recalled from
+     * any thread without allocating or locking.
+     */
+    struct Program {
+        /** The name of the program. Only accessed by the message thread. */
+        juce::String name;
+        std::array<std::atomic<float>, programParameterIDs.size()> values;
+        std::atomic<double> fadeDownTime { 1.0 };
+        std::atomic<double> fadeUpTime { 1.0 };
+    };
+
+    /** The preset bank. */
+    std::array<Program, numPrograms> programs;
+
+    /** The program that was recalled last. */
+    std::atomic<int> currentProgram { 0 };
+
+    /**
+     * A program that was recalled and still needs to be reported to the
+     * host, or -1 if there is none.
+     */
+    std::atomic<int> recalledProgram { -1 };
+
+   #if FADERVST_CPU_METER
+    /** Measures the time taken by processBlock. */
+    CpuLoadMeter cpuLoadMeter;
+   #endif
+
+    /** The cues played back along the timeline of the host. */
+    CueList cueList;
+
+    /** The commands received over OSC, waiting for the audio thread. */
+    RemoteCommandQueue remoteCommands;
+
+    /** Receives the OSC messages, on a thread of its own. */
+    OscRemote oscRemote { remoteCommands };
+
+    /** The port OSC messages are received on, or 0 if there is none. */
+    int oscPort = 0;
+
+    /** The time the OSC messages took to reach the audio thread. */
+    RemoteLatency oscLatency;
+
+    /** Whether the levels are measured. */
+    std::atomic<bool> meteringEnabled { false };
+
+    /**
+     * Whether the current block is measured, and its levels so far. Only
+     * accessed by the audio thread.
+     */
+    bool metering = false;
+    LevelMeter::Levels inputLevels;
+    LevelMeter::Levels outputLevels;
+
+    /** The levels of the blocks, on their way to the editor. */
+    LevelMeter::Queue levelReadings;
+
+    /** The value of sampleClock, published for other threads. */
+    std::atomic<juce::int64> publishedSampleClock { 0 };
+
+    /** The maximum number of commands that can take effect in a block. */
+    static constexpr int maxBlockCommands = 64;
+
+    /**
+     * The commands that take effect in the block being processed, ordered by
+     * their timestamps.
+     */
+    std::array<FadeCommand, maxBlockCommands> blockCommands;
+
+    /** The number of commands in blockCommands. */
+    int numBlockCommands = 0;
+
+    /** The MIDI mappings that trigger fades. */
+    MidiMappings midiMappings;
+
+    /** Set while the audio thread should hand the next MIDI trigger over. */
+    std::atomic<bool> learningMidi { false };
+
+    /** The trigger caught while learning, packed, or 0 if there is none. */
+    std::atomic<juce::uint32> learnedMidiTrigger { 0 };
+
+    /*
+     * The mapping being learned, or a slot of -1 if there is none. Only
+     * accessed by the message thread.
+     */
+    int learnSlot = -1;
+    FadeCommand::Target learnAction = FadeCommand::Toggle;
+    double learnDuration = 0.0;
+
+    /**
+     * Adds a command to blockCommands, keeping them ordered.
+     */
+    void addBlockCommand(const FadeCommand &command);
+
+    /**
+     * Turns the MIDI messages of the block into commands.
+     */
+    void handleMidi(const juce::MidiBuffer &midiMessages);
+
+    /**
+     * Stores the mapping for a trigger caught while learning, if any.
+     */
+    void finishMidiLearn();
+
+    /**
+     * Applies a fade command, at the current point of the block.
+     */
+    void applyFadeCommand(const FadeCommand &command);
+
+    /**
+     * Moves a command that was given at an offset of the current block to
+     * the next beat or bar, if the fades are synchronised to a rolling
+     * transport.
+     *
+     * A moved command that starts within the block is added to
+     * blockCommands, otherwise it replaces scheduledFade. Returns false if
+     * the command should be applied right away instead.
+     */
+    bool scheduleFade(const FadeCommand &command, int offset, int numSamples);
+
+    /**
+     * Converts the timestamp of scheduledFade to samples again, after the
+     * tempo has changed or the transport has jumped.
+     */
+    void rescheduleFade();
+
+    /**
+     * Returns the smoothing time in samples.
+     */
+    int getSmoothingSamples() const;
+
+    /**
+     * Sets a parameter to a normalised value from the audio thread, like the
+     * plugin wrappers do for automation.
+     */
+    static void setParameterValue(juce::RangedAudioParameter &parameter, float value);
+
+    /**
+     * Returns the current values of the parameters of the fading.
+     */
+    FadeEngine::Parameters getFadeParameters() const;
+
+    /**
+     * Processes a block, in either single or double precision.
+     */
+    template <typename SampleType>
+    void process(juce::AudioBuffer<SampleType> &buffer, juce::MidiBuffer &midiMessages);
+
+    /**
+     * Acts on the commands received over OSC since the last block.
+     */
+    void handleRemoteCommands();
+
+    /**
+     * Starts a fade on this instance, or on every member of its fade group
+     * if it fades all the channels.
+     */
+    void triggerFade(FadeCommand::Target target, double duration, juce::uint32 channels);
+
+    /**
+     * Adds the fades that the sidechain starts in this block, when ducking.
+     */
+    template <typename SampleType>
+    void handleSidechain(juce::AudioBuffer<SampleType> &buffer);
+
+    /**
+     * Applies the fading to a part of the buffer, crossfading with inputB if
+     * it is not nullptr.
+     */
+    template <typename SampleType>
+    void processSegment(juce::AudioBuffer<SampleType> &buffer, const juce::AudioBuffer<SampleType> *inputB, int startSample, int numSamples);
+
+    void parameterChanged(const juce::String &parameterID, float newValue) override;
+
+    void timerCallback() override;
+
+    /**
+     * Reports the telemetry to the host, if it has changed since the last
+     * time.
+     */
+    void reportTelemetry();
+
+    /**
+     * Sets the gain range received over OSC, if one was received since the
+     * last time, notifying the host.
+     */
+    void applyRequestedRange();
+
+    /**
+     * Notifies the host of the parameters changed by recalling a program,
+     * if one was recalled since the last time.
+     */
+    void reportRecalledProgram();
 
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FaderVSTAudioProcessor)
@@ -0,0 +1,347 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The hooks of RealtimeAudit.h.
+ *
+ * Functions defined in the executable take the place of the ones with the
+ * same name in the shared libraries, for every caller in the process. The
+ * allocation functions forward to the internal entry points of the allocator
+ * of the GNU C library, and the rest to the next definition found by the
+ * dynamic linker.
+ *
+ * Only the entry points of the C library are seen: a raw system call, or a
+ * call that the library makes to itself (e.g. printf writing to a file),
+ * bypasses them. Catching every system call would take seccomp or ptrace.
+ */
+
+#include "RealtimeAudit.h"
+
+#if defined(__linux__) && defined(__GLIBC__)
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/select.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *pointer);
+}
+
+namespace {
+
+/** The number of violations kept, and of frames kept per call stack. */
+constexpr int capacity = 64;
+constexpr int maxFrames = 32;
+
+struct Violation {
+	/** The function that was called. */
+	const char *function = nullptr;
+
+	std::array<void*, maxFrames> frames;
+	int numFrames = 0;
+
+	/** Whether the violation has been written completely. */
+	std::atomic<bool> written { false };
+};
+
+std::array<Violation, capacity> violations;
+
+/** The number of violations, which is also the ticket of the next slot. */
+std::atomic<int> numViolations { 0 };
+
+/** How many ScopedAudioThread objects the thread is in. */
+thread_local int audioDepth = 0;
+
+/**
+ * Whether the thread is recording a violation, so that the calls made while
+ * capturing the call stack are not recorded themselves.
+ */
+thread_local bool recording = false;
+
+/** Never inlined, so that the call stacks always start with it and the hook. */
+__attribute__((noinline)) void record(const char *function){
+	if (audioDepth == 0 || recording) return;
+	recording = true;
+
+	const int ticket = numViolations.fetch_add(1, std::memory_order_relaxed);
+	if (ticket < capacity){
+		auto &violation = violations[(size_t) ticket];
+		violation.function = function;
+		violation.numFrames = backtrace(violation.frames.data(), maxFrames);
+		violation.written.store(true, std::memory_order_release);
+	}
+
+	recording = false;
+}
+
+/**
+ * The real definition of a replaced function, looked up the first time it is
+ * needed.
+ */
+struct RealFunction {
+	const char *name;
+	std::atomic<void*> address { nullptr };
+
+	template <typename Function>
+	Function get(){
+		auto *function = address.load(std::memory_order_relaxed);
+		if (function == nullptr){
+			function = dlsym(RTLD_NEXT, name);
+			address.store(function, std::memory_order_relaxed);
+		}
+		return reinterpret_cast<Function>(function);
+	}
+};
+
+RealFunction realMutexLock { "pthread_mutex_lock" };
+RealFunction realRwlockRdlock { "pthread_rwlock_rdlock" };
+RealFunction realRwlockWrlock { "pthread_rwlock_wrlock" };
+RealFunction realCondWait { "pthread_cond_wait" };
+RealFunction realCondTimedwait { "pthread_cond_timedwait" };
+RealFunction realJoin { "pthread_join" };
+RealFunction realSemWait { "sem_wait" };
+RealFunction realSemTimedwait { "sem_timedwait" };
+RealFunction realRead { "read" };
+RealFunction realWrite { "write" };
+RealFunction realPoll { "poll" };
+RealFunction realSelect { "select" };
+RealFunction realNanosleep { "nanosleep" };
+RealFunction realClockNanosleep { "clock_nanosleep" };
+RealFunction realUsleep { "usleep" };
+RealFunction realSchedYield { "sched_yield" };
+
+RealFunction *const realFunctions[] = {
+	&realMutexLock, &realRwlockRdlock, &realRwlockWrlock, &realCondWait,
+	&realCondTimedwait, &realJoin, &realSemWait, &realSemTimedwait,
+	&realRead, &realWrite, &realPoll, &realSelect,
+	&realNanosleep, &realClockNanosleep, &realUsleep, &realSchedYield,
+};
+
+}
+
+namespace RealtimeAudit {
+
+void initialise(){
+	for (auto *real : realFunctions){
+		real->get<void*>();
+	}
+
+	// The first call loads the unwinder, which allocates
+	void *frames[1];
+	backtrace(frames, 1);
+}
+
+ScopedAudioThread::ScopedAudioThread(){
+	++audioDepth;
+}
+
+ScopedAudioThread::~ScopedAudioThread(){
+	--audioDepth;
+}
+
+int getNumViolations(){
+	return numViolations.load(std::memory_order_acquire);
+}
+
+void dump(std::ostream &stream){
+	const int total = getNumViolations();
+	stream << total << " real-time safety violation(s) in processBlock" << std::endl;
+
+	for (int i = 0; i < total && i < capacity; ++i){
+		const auto &violation = violations[(size_t) i];
+		if (! violation.written.load(std::memory_order_acquire)) continue;
+
+		stream << "#" << i << ": " << violation.function << std::endl;
+
+		auto **symbols = backtrace_symbols(violation.frames.data(), violation.numFrames);
+		// The first frames are record() and the hook itself
+		for (int frame = 2; frame < violation.numFrames; ++frame){
+			stream << "    " << (symbols != nullptr ? symbols[frame] : "?") << std::endl;
+		}
+		free(symbols);
+	}
+
+	if (total > capacity){
+		stream << "(" << total - capacity << " more not kept)" << std::endl;
+	}
+}
+
+}
+
+extern "C" {
+
+void *malloc(size_t size){
+	record("malloc");
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size){
+	record("calloc");
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size){
+	record("realloc");
+	return __libc_realloc(pointer, size);
+}
+
+void *memalign(size_t alignment, size_t size){
+	record("memalign");
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size){
+	record("aligned_alloc");
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size){
+	record("posix_memalign");
+	if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+
+	auto *memory = __libc_memalign(alignment, size);
+	if (memory == nullptr) return ENOMEM;
+
+	*pointer = memory;
+	return 0;
+}
+
+void free(void *pointer){
+	if (pointer != nullptr) record("free");
+	__libc_free(pointer);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex){
+	record("pthread_mutex_lock");
+	return realMutexLock.get<int (*)(pthread_mutex_t*)>()(mutex);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *lock){
+	record("pthread_rwlock_rdlock");
+	return realRwlockRdlock.get<int (*)(pthread_rwlock_t*)>()(lock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *lock){
+	record("pthread_rwlock_wrlock");
+	return realRwlockWrlock.get<int (*)(pthread_rwlock_t*)>()(lock);
+}
+
+int pthread_cond_wait(pthread_cond_t *condition, pthread_mutex_t *mutex){
+	record("pthread_cond_wait");
+	return realCondWait.get<int (*)(pthread_cond_t*, pthread_mutex_t*)>()(condition, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *condition, pthread_mutex_t *mutex, const struct timespec *time){
+	record("pthread_cond_timedwait");
+	return realCondTimedwait.get<int (*)(pthread_cond_t*, pthread_mutex_t*, const struct timespec*)>()(condition, mutex, time);
+}
+
+int pthread_join(pthread_t thread, void **result){
+	record("pthread_join");
+	return realJoin.get<int (*)(pthread_t, void**)>()(thread, result);
+}
+
+int sem_wait(sem_t *semaphore){
+	record("sem_wait");
+	return realSemWait.get<int (*)(sem_t*)>()(semaphore);
+}
+
+int sem_timedwait(sem_t *semaphore, const struct timespec *time){
+	record("sem_timedwait");
+	return realSemTimedwait.get<int (*)(sem_t*, const struct timespec*)>()(semaphore, time);
+}
+
+ssize_t read(int file, void *buffer, size_t size){
+	record("read");
+	return realRead.get<ssize_t (*)(int, void*, size_t)>()(file, buffer, size);
+}
+
+ssize_t write(int file, const void *buffer, size_t size){
+	record("write");
+	return realWrite.get<ssize_t (*)(int, const void*, size_t)>()(file, buffer, size);
+}
+
+int poll(struct pollfd *files, nfds_t numFiles, int timeout){
+	record("poll");
+	return realPoll.get<int (*)(struct pollfd*, nfds_t, int)>()(files, numFiles, timeout);
+}
+
+int select(int numFiles, fd_set *readFiles, fd_set *writeFiles, fd_set *exceptFiles, struct timeval *timeout){
+	record("select");
+	return realSelect.get<int (*)(int, fd_set*, fd_set*, fd_set*, struct timeval*)>()(numFiles, readFiles, writeFiles, exceptFiles, timeout);
+}
+
+int nanosleep(const struct timespec *duration, struct timespec *remaining){
+	record("nanosleep");
+	return realNanosleep.get<int (*)(const struct timespec*, struct timespec*)>()(duration, remaining);
+}
+
+int clock_nanosleep(clockid_t clock, int flags, const struct timespec *time, struct timespec *remaining){
+	record("clock_nanosleep");
+	return realClockNanosleep.get<int (*)(clockid_t, int, const struct timespec*, struct timespec*)>()(clock, flags, time, remaining);
+}
+
+int usleep(useconds_t microseconds){
+	record("usleep");
+	return realUsleep.get<int (*)(useconds_t)>()(microseconds);
+}
+
+int sched_yield(){
+	record("sched_yield");
+	return realSchedYield.get<int (*)()>()();
+}
+
+}
+
+#else
+
+namespace RealtimeAudit {
+
+void initialise(){}
+
+ScopedAudioThread::ScopedAudioThread(){}
+
+ScopedAudioThread::~ScopedAudioThread(){}
+
+int getNumViolations(){
+	return 0;
+}
+
+void dump(std::ostream &stream){
+	stream << "The real-time safety audit is only supported on Linux with the GNU C library" << std::endl;
+}
+
+}
+
+#endif
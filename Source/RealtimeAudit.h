@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <ostream>
+
+/*
+ * Whether the audio thread is audited, set by the FADERVST_RT_AUDIT option of
+ * CMake. Only FaderVSTBench is ever built with it, since the hooks replace
+ * functions of the C library for the whole executable.
+ */
+#ifndef FADERVST_RT_AUDIT
+ #define FADERVST_RT_AUDIT 0
+#endif
+
+/**
+ * Catches the audio processing doing anything that may allocate or block.
+ *
+ * The memory allocation functions, the locking functions and the C library
+ * wrappers of the system calls that may block are replaced by hooks that
+ * forward to the real ones. When a hook is called on a thread that is inside
+ * processBlock, the violation is recorded along with its call stack, into a
+ * fixed buffer that is written without locking or allocating, and which is
+ * dumped once the processing has finished.
+ *
+ * Implemented in RealtimeAudit.cpp, for Linux with the GNU C library.
+ */
+namespace RealtimeAudit {
+
+/**
+ * Resolves the real functions behind the hooks and loads what capturing a
+ * call stack needs, so that neither happens for the first time inside the
+ * audio processing. Called once at the start of the program.
+ */
+void initialise();
+
+/**
+ * Marks the calling thread as processing audio for the lifetime of the
+ * object. Nests, so that a processBlock calling another one is fine.
+ */
+class ScopedAudioThread {
+public:
+	ScopedAudioThread();
+	~ScopedAudioThread();
+
+	ScopedAudioThread(const ScopedAudioThread&) = delete;
+	ScopedAudioThread& operator=(const ScopedAudioThread&) = delete;
+};
+
+/**
+ * Returns the number of violations so far, including the ones that did not
+ * fit in the buffer.
+ */
+int getNumViolations();
+
+/**
+ * Writes the recorded violations and their (symbolised) call stacks to a
+ * stream. Must not be called while audio is being processed.
+ */
+void dump(std::ostream &stream);
+
+}
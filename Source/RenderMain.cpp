@@ -0,0 +1,382 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A headless batch renderer that applies fades to audio files.
+ *
+ * Every file is streamed in chunks through its own FaderVSTAudioProcessor,
+ * with the fades posted as timestamped commands, so the output does not
+ * depend on the chunk size. The files are spread over a thread pool.
+ *
+ * Usage: FaderVSTRender --out=<directory> [options] <input>...
+ *
+ *   --fade-in=<start>,<duration>   Fade up from the low gain, which is held
+ *                                  until <start> (in seconds).
+ *   --fade-out=<start>,<duration>  Fade down to the low gain. A negative
+ *                                  <start> counts from the end of the file.
+ *   --range=<low>,<high>           The gain range (default 0,1).
+ *   --curve=<name>                 The fade curve (default Linear).
+ *   --chunk=<samples>              The chunk size (default 4096).
+ *   --threads=<count>              The number of threads (default: one per
+ *                                  CPU core).
+ *   --check                        Also render every file in chunks of 32
+ *                                  samples, and fail if the output differs
+ *                                  in any bit.
+ *
+ * The outputs have the same names, formats and bit depths as the inputs.
+ */
+
+#include "PluginProcessor.h"
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+/**
+ * The fades to apply to every file.
+ */
+struct FadeSpec {
+    bool fadeIn = false;
+    double fadeInStart = 0.0;
+    double fadeInDuration = 0.0;
+
+    bool fadeOut = false;
+    double fadeOutStart = 0.0;
+    double fadeOutDuration = 0.0;
+
+    float low = 0.0f;
+    float high = 1.0f;
+    FadeCurve::Shape curve = FadeCurve::Linear;
+};
+
+/**
+ * Sets a parameter of the processor to a (non normalised) value.
+ */
+void setParameter(juce::AudioProcessor &processor, const juce::String &id, float value){
+    for (auto *param : processor.getParameters()){
+        if (auto *ranged = dynamic_cast<juce::RangedAudioParameter*>(param)){
+            if (ranged->paramID == id){
+                ranged->setValueNotifyingHost(ranged->convertTo0to1(value));
+                return;
+            }
+        }
+    }
+}
+
+/**
+ * Parses a pair of comma separated numbers, returning false if the text is
+ * not one.
+ */
+bool parsePair(const juce::String &text, double &first, double &second){
+    const auto fields = juce::StringArray::fromTokens(text, ",", "");
+    if (fields.size() != 2) return false;
+
+    first = fields[0].trim().getDoubleValue();
+    second = fields[1].trim().getDoubleValue();
+    return true;
+}
+
+/** Serialises the messages of the jobs. */
+juce::CriticalSection outputLock;
+
+void report(const juce::String &message, bool isError){
+    const juce::ScopedLock lock(outputLock);
+    (isError ? std::cerr : std::cout) << message << std::endl;
+}
+
+/**
+ * Renders a single file.
+ */
+class RenderJob : public juce::ThreadPoolJob {
+public:
+    RenderJob(juce::AudioFormatManager &formatManager, const juce::File &input, const juce::File &output,
+              const FadeSpec &spec, int chunkSize, bool check, std::atomic<int> &failures)
+        : ThreadPoolJob(input.getFileName()), formatManager(formatManager), input(input), output(output),
+          spec(spec), chunkSize(chunkSize), check(check), failures(failures) {}
+
+    JobStatus runJob() override {
+        if (! render()){
+            ++failures;
+        }
+        return jobHasFinished;
+    }
+
+private:
+    juce::AudioFormatManager &formatManager;
+    juce::File input;
+    juce::File output;
+    FadeSpec spec;
+    int chunkSize;
+    bool check;
+    std::atomic<int> &failures;
+
+    /** The chunk size of the second rendering made by --check. */
+    static constexpr int checkChunkSize = 32;
+
+    /**
+     * Opens a reader for the input, memory mapping the file where the format
+     * allows it (WAV and AIFF).
+     */
+    std::unique_ptr<juce::AudioFormatReader> createReader(juce::AudioFormat &format){
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped(format.createMemoryMappedReader(input));
+        if (mapped != nullptr && mapped->mapEntireFile()){
+            return mapped;
+        }
+
+        return std::unique_ptr<juce::AudioFormatReader>(format.createReaderFor(input.createInputStream().release(), true));
+    }
+
+    /**
+     * Sets up a processor like a host would, with the fades of the spec
+     * posted, for a file and a chunk size.
+     */
+    bool setUp(FaderVSTAudioProcessor &processor, int numChannels, double sampleRate, juce::int64 length, int blockSize){
+        // The sidechain keeps its default (disabled) layout
+        auto busesLayout = processor.getBusesLayout();
+        busesLayout.inputBuses.set(0, juce::AudioChannelSet::canonicalChannelSet(numChannels));
+        busesLayout.outputBuses.set(0, juce::AudioChannelSet::canonicalChannelSet(numChannels));
+        if (busesLayout.getMainInputChannelSet().isDisabled() || ! processor.setBusesLayout(busesLayout)){
+            busesLayout.inputBuses.set(0, juce::AudioChannelSet::discreteChannels(numChannels));
+            busesLayout.outputBuses.set(0, juce::AudioChannelSet::discreteChannels(numChannels));
+            if (! processor.setBusesLayout(busesLayout)){
+                report(input.getFullPathName() + ": unsupported number of channels", true);
+                return false;
+            }
+        }
+
+        setParameter(processor, "curve", (float) spec.curve);
+        processor.setGainRange(spec.low, spec.high);
+        processor.prepareToPlay(sampleRate, blockSize);
+
+        // Post the fades in the order of their timestamps, since the queue
+        // hands them to the audio thread in order
+        std::vector<FadeCommand> commands;
+        if (spec.fadeIn){
+            commands.push_back({ FadeCommand::Down, 0.0, 0 });
+            commands.push_back({ FadeCommand::Up, spec.fadeInDuration, (juce::int64) std::llround(spec.fadeInStart * sampleRate) });
+        }
+        if (spec.fadeOut){
+            const double start = spec.fadeOutStart < 0.0 ? length / sampleRate + spec.fadeOutStart : spec.fadeOutStart;
+            commands.push_back({ FadeCommand::Down, spec.fadeOutDuration, (juce::int64) std::llround(start * sampleRate) });
+        }
+        std::stable_sort(commands.begin(), commands.end(), [](const FadeCommand &a, const FadeCommand &b){
+            return a.timestamp < b.timestamp;
+        });
+        for (const auto &command : commands){
+            processor.postFadeCommand(command);
+        }
+
+        return true;
+    }
+
+    bool render(){
+        auto *format = formatManager.findFormatForFileExtension(input.getFileExtension());
+        if (format == nullptr){
+            report(input.getFullPathName() + ": unsupported format", true);
+            return false;
+        }
+
+        const auto reader = createReader(*format);
+        if (reader == nullptr){
+            report(input.getFullPathName() + ": cannot be read", true);
+            return false;
+        }
+
+        const int numChannels = (int) reader->numChannels;
+        const double sampleRate = reader->sampleRate;
+        const juce::int64 length = reader->lengthInSamples;
+
+        // Keep the bit depth of the input, if the format can write it
+        auto bitDepths = format->getPossibleBitDepths();
+        const int bitDepth = bitDepths.contains((int) reader->bitsPerSample) ? (int) reader->bitsPerSample : bitDepths.getLast();
+
+        output.deleteFile();
+        std::unique_ptr<juce::OutputStream> stream = output.createOutputStream();
+        if (stream == nullptr){
+            report(output.getFullPathName() + ": cannot be written", true);
+            return false;
+        }
+
+        std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(stream.get(), sampleRate, (unsigned int) numChannels, bitDepth, reader->metadataValues, 0));
+        if (writer == nullptr){
+            report(output.getFullPathName() + ": cannot be written in this format", true);
+            return false;
+        }
+        stream.release();
+
+        FaderVSTAudioProcessor processor;
+        if (! setUp(processor, numChannels, sampleRate, length, chunkSize)){
+            return false;
+        }
+
+        // With --check, a second processor renders the same audio in small
+        // chunks alongside
+        std::unique_ptr<FaderVSTAudioProcessor> checkProcessor;
+        if (check){
+            checkProcessor = std::make_unique<FaderVSTAudioProcessor>();
+            setUp(*checkProcessor, numChannels, sampleRate, length, checkChunkSize);
+        }
+
+        // Stream the file through a single reusable buffer
+        juce::AudioBuffer<float> chunk(numChannels, chunkSize);
+        juce::AudioBuffer<float> checkChunk(check ? numChannels : 0, chunkSize);
+        juce::MidiBuffer midi;
+
+        for (juce::int64 position = 0; position < length; position += chunkSize){
+            const int numSamples = (int) juce::jmin((juce::int64) chunkSize, length - position);
+
+            reader->read(&chunk, 0, numSamples, position, true, true);
+            if (check){
+                checkChunk.makeCopyOf(chunk, true);
+            }
+
+            // A view of the start of the chunk, so that the last one can be
+            // shorter without reallocating
+            juce::AudioBuffer<float> block(chunk.getArrayOfWritePointers(), numChannels, numSamples);
+            processor.processBlock(block, midi);
+
+            if (check){
+                for (int offset = 0; offset < numSamples; offset += checkChunkSize){
+                    juce::AudioBuffer<float> checkBlock(checkChunk.getArrayOfWritePointers(), numChannels, offset, juce::jmin(checkChunkSize, numSamples - offset));
+                    checkProcessor->processBlock(checkBlock, midi);
+                }
+
+                for (int channel = 0; channel < numChannels; ++channel){
+                    if (std::memcmp(block.getReadPointer(channel), checkChunk.getReadPointer(channel), sizeof(float) * (size_t) numSamples) != 0){
+                        report(input.getFullPathName() + ": the output depends on the chunk size, around sample " + juce::String(position), true);
+                        return false;
+                    }
+                }
+            }
+
+            if (! writer->writeFromAudioSampleBuffer(block, 0, numSamples)){
+                report(output.getFullPathName() + ": write failed", true);
+                return false;
+            }
+        }
+
+        processor.releaseResources();
+        if (check){
+            checkProcessor->releaseResources();
+        }
+
+        report(input.getFullPathName() + " -> " + output.getFullPathName(), false);
+        return true;
+    }
+};
+
+}
+
+int main(int argc, char *argv[]){
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    const juce::ArgumentList arguments(argc, argv);
+
+    const auto outputDirectory = juce::File::getCurrentWorkingDirectory().getChildFile(arguments.getValueForOption("--out"));
+    if (! arguments.containsOption("--out") || ! outputDirectory.createDirectory()){
+        std::cerr << "An output directory must be given with --out=<directory>" << std::endl;
+        return 1;
+    }
+
+    FadeSpec spec;
+
+    if (arguments.containsOption("--fade-in")){
+        spec.fadeIn = parsePair(arguments.getValueForOption("--fade-in"), spec.fadeInStart, spec.fadeInDuration);
+        if (! spec.fadeIn){
+            std::cerr << "--fade-in expects <start>,<duration>" << std::endl;
+            return 1;
+        }
+    }
+
+    if (arguments.containsOption("--fade-out")){
+        spec.fadeOut = parsePair(arguments.getValueForOption("--fade-out"), spec.fadeOutStart, spec.fadeOutDuration);
+        if (! spec.fadeOut){
+            std::cerr << "--fade-out expects <start>,<duration>" << std::endl;
+            return 1;
+        }
+    }
+
+    if (arguments.containsOption("--range")){
+        double low, high;
+        if (! parsePair(arguments.getValueForOption("--range"), low, high)){
+            std::cerr << "--range expects <low>,<high>" << std::endl;
+            return 1;
+        }
+        spec.low = (float) juce::jlimit(0.0, 1.0, low);
+        spec.high = (float) juce::jlimit(0.0, 1.0, high);
+    }
+
+    if (arguments.containsOption("--curve")){
+        const int curve = FadeCurve::getNames().indexOf(arguments.getValueForOption("--curve"), true);
+        if (curve < 0){
+            std::cerr << "--curve expects one of: " << FadeCurve::getNames().joinIntoString(", ") << std::endl;
+            return 1;
+        }
+        spec.curve = (FadeCurve::Shape) curve;
+    }
+
+    const int chunkSize = arguments.containsOption("--chunk") ? arguments.getValueForOption("--chunk").getIntValue() : 4096;
+    if (chunkSize <= 0){
+        std::cerr << "--chunk expects a positive number of samples" << std::endl;
+        return 1;
+    }
+
+    const bool check = arguments.containsOption("--check");
+
+    const int numThreads = arguments.containsOption("--threads") ? arguments.getValueForOption("--threads").getIntValue() : juce::SystemStats::getNumCpus();
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    std::atomic<int> failures { 0 };
+    juce::ThreadPool pool(juce::jmax(1, numThreads));
+    int numJobs = 0;
+
+    for (const auto &argument : arguments.arguments){
+        if (argument.isOption()) continue;
+
+        const auto input = argument.resolveAsFile();
+        const auto output = outputDirectory.getChildFile(input.getFileName());
+        if (! input.existsAsFile()){
+            report(input.getFullPathName() + ": not found", true);
+            ++failures;
+            continue;
+        }
+        if (output == input){
+            report(input.getFullPathName() + ": would be overwritten", true);
+            ++failures;
+            continue;
+        }
+
+        pool.addJob(new RenderJob(formatManager, input, output, spec, chunkSize, check, failures), true);
+        ++numJobs;
+    }
+
+    if (numJobs == 0 && failures == 0){
+        std::cerr << "No input files were given" << std::endl;
+        return 1;
+    }
+
+    while (pool.getNumJobs() > 0){
+        juce::Thread::sleep(10);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
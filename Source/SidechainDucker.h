@@ -0,0 +1,134 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+#include "FadeCommandQueue.h"
+#include <array>
+#include <tuple>
+
+/**
+ * Decides when to duck the audio, from the level of a sidechain signal.
+ *
+ * The envelope of the sidechain is a peak hold: it rises on the first sample
+ * above the threshold, which starts a fade down on that same sample, so the
+ * detection adds no latency. It falls once no sample has gone above the
+ * threshold for the hold time, which starts a fade up. The attack and
+ * release times are the durations of those fades.
+ *
+ * The sidechain is scanned in chunks with the vector operations of JUCE,
+ * looking at single samples only in the chunks where the envelope changes.
+ *
+ * Only used by the audio thread.
+ */
+class SidechainDucker {
+public:
+	/**
+	 * Sets the threshold (as a gain) and the hold time (in samples).
+	 */
+	void setParameters(float newThreshold, juce::int64 newHoldSamples){
+		threshold = newThreshold;
+		holdSamples = juce::jmax((juce::int64) 0, newHoldSamples);
+	}
+
+	/**
+	 * Releases the envelope without starting a fade, e.g. when the mode is
+	 * turned off.
+	 */
+	void reset(){
+		ducked = false;
+	}
+
+	/** Returns true while the envelope is above the threshold or holding. */
+	bool isDucked() const {
+		return ducked;
+	}
+
+	/**
+	 * Scans the sidechain of a block, calling duck(target, offset) with
+	 * FadeCommand::Down or FadeCommand::Up at the samples where the envelope
+	 * rises or falls.
+	 */
+	template <typename SampleType, typename Callback>
+	void process(const SampleType *const *channels, int numChannels, int numSamples, Callback &&duck){
+		auto &chunk = std::get<Chunk<SampleType>>(chunks);
+
+		for (int start = 0; start < numSamples; start += chunkSize){
+			const int size = juce::jmin(chunkSize, numSamples - start);
+
+			// The magnitude of the loudest channel at every sample
+			juce::FloatVectorOperations::clear(chunk.magnitudes.data(), size);
+			for (int channel = 0; channel < numChannels; ++channel){
+				juce::FloatVectorOperations::abs(chunk.scratch.data(), channels[channel] + start, size);
+				juce::FloatVectorOperations::max(chunk.magnitudes.data(), chunk.magnitudes.data(), chunk.scratch.data(), size);
+			}
+
+			const bool above = juce::FloatVectorOperations::findMaximum(chunk.magnitudes.data(), size) >= (SampleType) threshold;
+
+			if (above){
+				if (! ducked){
+					int first = 0;
+					while (chunk.magnitudes[(size_t) first] < (SampleType) threshold) ++first;
+
+					ducked = true;
+					duck(FadeCommand::Down, start + first);
+				}
+
+				int last = size - 1;
+				while (chunk.magnitudes[(size_t) last] < (SampleType) threshold) --last;
+
+				release = start + last + 1 + holdSamples;
+			}
+
+			if (ducked && release < start + size){
+				ducked = false;
+				duck(FadeCommand::Up, (int) juce::jmax((juce::int64) start, release));
+			}
+		}
+
+		// Count the release from the start of the next block
+		release -= numSamples;
+	}
+
+private:
+	/** The number of samples scanned at once. */
+	static constexpr int chunkSize = 256;
+
+	template <typename SampleType>
+	struct Chunk {
+		std::array<SampleType, chunkSize> magnitudes;
+		std::array<SampleType, chunkSize> scratch;
+	};
+
+	/** The chunk buffers for single and double precision. */
+	std::tuple<Chunk<float>, Chunk<double>> chunks;
+
+	float threshold = 1.0f;
+	juce::int64 holdSamples = 0;
+
+	/** Whether the envelope is above the threshold. */
+	bool ducked = false;
+
+	/**
+	 * The sample where the envelope falls, relative to the start of the
+	 * current block, while ducked.
+	 */
+	juce::int64 release = 0;
+};
@@ -0,0 +1,228 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+/*
+ * Copyright 2023 Achilleas Michailidis <achmichail@gmail.com>
+ *
+ * This file is part of FaderVST.
+ *
+ * FaderVST is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <cmath>
+
+/**
+ * Follows the transport of the host, to place fades on its musical grid.
+ *
+ * Positions are measured in quarter notes (PPQ), like the host reports them,
+ * while beats and bars follow the time signature. When the host does not
+ * report a tempo or a time signature, 120 BPM in 4/4 is assumed.
+ *
+ * Only used by the audio thread.
+ */
+class TransportSync {
+public:
+	/** Where a fade starts. */
+	enum Start {
+		/** At the sample the command was given. */
+		Immediately,
+		/** On the next beat of the time signature. */
+		NextBeat,
+		/** On the next downbeat. */
+		NextBar,
+	};
+
+	/** The unit of the durations of the fades. */
+	enum Unit {
+		Seconds,
+		Beats,
+		Bars,
+	};
+
+	/** The names of the starts, in the order of the Start enum. */
+	static juce::StringArray getStartNames(){
+		return { "Immediately", "Next beat", "Next bar" };
+	}
+
+	/** The names of the units, in the order of the Unit enum. */
+	static juce::StringArray getUnitNames(){
+		return { "Seconds", "Beats", "Bars" };
+	}
+
+	/**
+	 * Reads the position of the transport at the start of a block.
+	 *
+	 * Returns true if the tempo or the time signature changed, or the
+	 * transport started, stopped or jumped (e.g. wrapped around a loop) since
+	 * the last block. Musical positions that were converted to samples need to
+	 * be converted again then.
+	 */
+	bool update(juce::AudioPlayHead *playHead, double newSampleRate, int numSamples){
+		const double previousBpm = bpm;
+		const double previousBeatsPerBar = getBeatsPerBar();
+		const bool wasPlaying = playing;
+
+		sampleRate = newSampleRate;
+		playing = false;
+
+		if (playHead != nullptr){
+			if (const auto position = playHead->getPosition()){
+				if (const auto newBpm = position->getBpm()){
+					if (*newBpm > 0.0) bpm = *newBpm;
+				}
+
+				if (const auto signature = position->getTimeSignature()){
+					if (signature->numerator > 0 && signature->denominator > 0){
+						numerator = signature->numerator;
+						denominator = signature->denominator;
+					}
+				}
+
+				if (const auto newTime = position->getTimeInSeconds()){
+					time = *newTime;
+				}
+
+				if (const auto newPpq = position->getPpqPosition()){
+					ppq = *newPpq;
+					playing = position->getIsPlaying();
+				}
+
+				if (const auto newBarStart = position->getPpqPositionOfLastBarStart()){
+					barStart = *newBarStart;
+				} else {
+					barStart = std::floor(ppq / getBeatsPerBar()) * getBeatsPerBar();
+				}
+			}
+		}
+
+		// A jump is any distance of more than a sample from where the
+		// previous block ended
+		const bool jumped = std::abs(ppq - expectedPpq) * getSamplesPerBeat() > 1.0
+		                 || std::abs(time - expectedTime) * sampleRate > 1.0;
+		expectedPpq = ppq + numSamples / getSamplesPerBeat();
+		expectedTime = time + numSamples / sampleRate;
+
+		relocated = playing && (jumped || ! wasPlaying);
+
+		return playing != wasPlaying
+		    || relocated
+		    || bpm != previousBpm
+		    || getBeatsPerBar() != previousBeatsPerBar;
+	}
+
+	/** Returns true if the transport is rolling. */
+	bool isPlaying() const {
+		return playing;
+	}
+
+	/**
+	 * Returns true if the transport started or jumped at the start of the
+	 * current block.
+	 */
+	bool hasRelocated() const {
+		return relocated;
+	}
+
+	/** Returns the time at the start of the current block, in seconds. */
+	double getTime() const {
+		return time;
+	}
+
+	/** Returns the length of a quarter note, in samples. */
+	double getSamplesPerBeat() const {
+		return sampleRate * 60.0 / bpm;
+	}
+
+	/** Returns the length of a beat of the time signature, in quarter notes. */
+	double getBeatLength() const {
+		return 4.0 / denominator;
+	}
+
+	/** Returns the length of a bar, in quarter notes. */
+	double getBeatsPerBar() const {
+		return numerator * getBeatLength();
+	}
+
+	/**
+	 * Returns the position of a sample of the current block, in quarter
+	 * notes.
+	 */
+	double getPosition(int offset) const {
+		return ppq + offset / getSamplesPerBeat();
+	}
+
+	/**
+	 * Returns the distance of a position from the start of the current
+	 * block, in samples.
+	 */
+	double getOffset(double position) const {
+		return (position - ppq) * getSamplesPerBeat();
+	}
+
+	/** Returns the distance between the points a fade can start at. */
+	double getGridLength(Start start) const {
+		return start == NextBar ? getBeatsPerBar() : getBeatLength();
+	}
+
+	/**
+	 * Returns the first point a fade can start at, at or after a position.
+	 */
+	double getNextGridPosition(Start start, double position) const {
+		if (start == Immediately) return position;
+
+		const double gridLength = getGridLength(start);
+
+		// Positions within a thousandth of a beat count as on the grid, to
+		// absorb the rounding of the host
+		const double index = std::ceil((position - barStart) / gridLength - 0.001);
+		return barStart + index * gridLength;
+	}
+
+	/**
+	 * Converts a duration to quarter notes, or returns 0 if it is in
+	 * seconds.
+	 */
+	double toQuarterNotes(Unit unit, double duration) const {
+		switch (unit){
+			case Seconds: return 0.0;
+			case Beats: return duration * getBeatLength();
+			case Bars: return duration * getBeatsPerBar();
+		}
+
+		return 0.0;
+	}
+
+private:
+	double sampleRate = 44100.0;
+	double bpm = 120.0;
+	int numerator = 4;
+	int denominator = 4;
+	bool playing = false;
+	bool relocated = false;
+
+	/** The time at the start of the current block, in seconds. */
+	double time = 0.0;
+
+	/** The time the next block should start at, if nothing jumps. */
+	double expectedTime = 0.0;
+
+	/** The position at the start of the current block. */
+	double ppq = 0.0;
+
+	/** The position of the last downbeat before the current block. */
+	double barStart = 0.0;
+
+	/** The position the next block should start at, if nothing jumps. */
+	double expectedPpq = 0.0;
+};
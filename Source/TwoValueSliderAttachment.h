@@ -25,6 +25,9 @@
 /**
  * Attaches a two value slider to two parameters, one for the min and one for
  * the max value.
+ *
+ * Like LabelAttachment, the slider pulls the values of the parameters once
+ * per frame of the display, and is only moved when they have changed.
  */
 class TwoValueSliderAttachment : private juce::Slider::Listener {
 public:
@@ -33,12 +36,11 @@ public:
 		juce::RangedAudioParameter &minParam,
 		juce::RangedAudioParameter &maxParam
 	) : slider(slider),
-		minAttachment(minParam, [this](float v){
-			this->slider.setMinValue(v, juce::sendNotificationSync);
-		}),
-		maxAttachment(maxParam, [this](float v){
-			this->slider.setMaxValue(v, juce::sendNotificationSync);
-		})
+		minParam(minParam),
+		maxParam(maxParam),
+		minAttachment(minParam, [](float){}),
+		maxAttachment(maxParam, [](float){}),
+		vBlankAttachment(&slider, [this](){ this->update(); })
 	{
 		slider.addListener(this);
 	}
@@ -50,9 +52,31 @@ public:
 private:
 	juce::Slider &slider;
 
+	juce::RangedAudioParameter &minParam;
+	juce::RangedAudioParameter &maxParam;
+
 	juce::ParameterAttachment minAttachment;
 	juce::ParameterAttachment maxAttachment;
 
+	juce::VBlankAttachment vBlankAttachment;
+
+	/** The values the slider was last moved to. */
+	double displayedMin = std::numeric_limits<double>::quiet_NaN();
+	double displayedMax = std::numeric_limits<double>::quiet_NaN();
+
+	void update(){
+		// Do not move the thumbs from under the mouse
+		if (slider.getThumbBeingDragged() >= 0) return;
+
+		const double min = minParam.convertFrom0to1(minParam.getValue());
+		const double max = maxParam.convertFrom0to1(maxParam.getValue());
+		if (min == displayedMin && max == displayedMax) return;
+
+		displayedMin = min;
+		displayedMax = max;
+		slider.setMinAndMaxValues(min, max, juce::dontSendNotification);
+	}
+
 	void sliderValueChanged(juce::Slider *slider) override {
 		minAttachment.setValueAsPartOfGesture(slider->getMinValue());
 		maxAttachment.setValueAsPartOfGesture(slider->getMaxValue());
@@ -67,4 +91,4 @@ private:
 		minAttachment.endGesture();
 		maxAttachment.endGesture();
 	}
-};
\ No newline at end of file
+};
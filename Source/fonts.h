@@ -22,22 +22,37 @@
 #include <juce_graphics/juce_graphics.h>
 #include <BinaryData.h>
 
+/**
+ * The fonts bundled with the plugin.
+ *
+ * The typefaces are created from the binary data once, and shared by every
+ * editor of the process along with the glyphs they have cached. They are
+ * held by a juce::SharedResourcePointer that every editor keeps, so that they
+ * are released with the last editor rather than when the plugin is unloaded,
+ * after JUCE has shut down.
+ */
 namespace fonts {
 
 	using juce::Font;
 	using juce::Typeface;
 
-	static Font NotoSans(){
-		return Font(Typeface::createSystemTypefaceFor(
+	/** The typefaces, shared through a juce::SharedResourcePointer. */
+	struct Typefaces {
+		const Typeface::Ptr regular = Typeface::createSystemTypefaceFor(
 			BinaryData::NotoSansRegular_ttf,
 			BinaryData::NotoSansRegular_ttfSize
-		));
-	}
-
-	static Font NotoSansBold(){
-		return Font(Typeface::createSystemTypefaceFor(
+		);
+		const Typeface::Ptr bold = Typeface::createSystemTypefaceFor(
 			BinaryData::NotoSansBold_ttf,
 			BinaryData::NotoSansBold_ttfSize
-		));
+		);
+	};
+
+	inline Font NotoSans(){
+		return Font(juce::SharedResourcePointer<Typefaces>()->regular);
+	}
+
+	inline Font NotoSansBold(){
+		return Font(juce::SharedResourcePointer<Typefaces>()->bold);
 	}
-}
\ No newline at end of file
+}